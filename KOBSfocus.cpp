@@ -132,7 +132,8 @@ bool FocusRpi::Connect()
         LOGF_INFO("PowerHub Firmware Version: %i.%i", (psversion & 0xFF00) >> 8, psversion & 0xFF);
         
         // only setting up unipolar for now
-        psctl.activateProfile(UNI_12V);
+        if ( ! psctl.activateProfile(UNI_12V))
+            LOGF_ERROR("Profile not applied, left as it was: %s", psctl.profileReport().c_str());
 
         LOGF_INFO("Humidity @ opening: %#.1f", psctl.getHumidity());
         LOGF_INFO("Temperature @ opening: %#.1f", psctl.getTemperature());
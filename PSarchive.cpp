@@ -0,0 +1,432 @@
+/***************************************************************
+*  Program:      PSarchive.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star telemetry archive writer
+****************************************************************/
+
+#include "PSarchive.h"
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+// name, unit, archive resolution - order must match PS_CHANNEL
+const psChannel psChannels[PS_NCHAN] = {
+        { "Ports",        "mask", 1     },
+        { "AutoBoot",     "mask", 1     },
+        { "Dew1.set",     "%",    1     },
+        { "Dew2.set",     "%",    1     },
+        { "IN.volts",     "V",    0.001 },
+        { "Var.volts",    "V",    0.001 },
+        { "Int.volts",    "V",    0.001 },
+        { "Out1.current", "A",    0.001 },
+        { "Out2.current", "A",    0.001 },
+        { "Out3.current", "A",    0.001 },
+        { "Out4.current", "A",    0.001 },
+        { "Dew1.current", "A",    0.001 },
+        { "Dew2.current", "A",    0.001 },
+        { "Var.current",  "A",    0.001 },
+        { "MP.current",   "A",    0.001 },
+        { "IN.current",   "A",    0.001 },
+        { "Temp",         "F",    0.1   },
+        { "Hum",          "%",    1     },
+        { "Var.set",      "V",    0.1   },
+        { "MP.mode",      "",     1     },
+        { "LED",          "",     1     },
+        { "FM",           "",     1     }
+        };
+
+// worst case block size, anything bigger past the last good block is not a torn tail
+static const size_t PSA_MAX_BLOCK = sizeof(psaHeader) + sizeof(psaTrailer)
+                                    + PSA_BLOCK_SAMPLES * (PS_NCHAN + 1) * 10;
+
+//******************************************************************
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+//******************************************************************
+static void putVarint(vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+//******************************************************************
+// delta + varint, a zero delta is followed by the count of further repeats
+template <typename T>
+static void encodeColumn(vector<uint8_t> &out, const T *v, uint32_t n)
+{
+    int64_t prev = 0;
+    uint32_t i = 0;
+
+    while (i < n) {
+        int64_t delta = (int64_t)v[i] - prev;
+        prev = v[i++];
+        putVarint(out, zigzag(delta));
+
+        if (delta == 0) {
+            uint32_t run = 0;
+            while (i < n && (int64_t)v[i] == prev) {
+                run++;
+                i++;
+            }
+            putVarint(out, run);
+        }
+    }
+}
+
+//******************************************************************
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ( ! (b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+//******************************************************************
+static bool decodeColumn(const uint8_t *p, const uint8_t *end, int64_t *out, uint32_t n)
+{
+    int64_t prev = 0;
+    uint32_t i = 0;
+    uint64_t v;
+
+    while (i < n) {
+        if ( ! getVarint(p, end, v))
+            return false;
+
+        int64_t delta = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        prev += delta;
+        out[i++] = prev;
+
+        if (delta == 0) {
+            if ( ! getVarint(p, end, v) || v > n - i)
+                return false;
+            while (v--)
+                out[i++] = prev;
+        }
+    }
+    return true;
+}
+
+//******************************************************************
+PSARCHIVE::PSARCHIVE()
+{
+    memset(lastValue, 0, sizeof(lastValue));
+}
+
+//******************************************************************
+PSARCHIVE::~PSARCHIVE()
+{
+    close();
+}
+
+//******************************************************************
+bool PSARCHIVE::open(const char *path)
+{
+    close();
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return false;
+
+    if ( ! repairTail()) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    count = 0;
+    buffer.reserve(PSA_MAX_BLOCK);
+    return true;
+}
+
+//******************************************************************
+void PSARCHIVE::close()
+{
+    if (fd < 0)
+        return;
+
+    flush();
+    ::close(fd);
+    fd = -1;
+}
+
+//******************************************************************
+// Poll path: quantize into the open block, encoding waits for flush
+void PSARCHIVE::append(const psSample &sample)
+{
+    if (fd < 0)
+        return;
+
+    times[count] = sample.time;
+    for (int c = 0; c < PS_NCHAN; c++) {
+        if (std::isfinite(sample.value[c]))
+            lastValue[c] = (int32_t)lround(sample.value[c] / psChannels[c].resolution);
+        values[c][count] = lastValue[c];
+    }
+    count++;
+
+    if (count == PSA_BLOCK_SAMPLES || sample.time - times[0] >= PSA_FLUSH_SECS * 1000ULL)
+        flush();
+}
+
+//******************************************************************
+bool PSARCHIVE::flush()
+{
+    if (fd < 0 || count == 0)
+        return true;
+
+    psaHeader header = { PSA_MAGIC, PSA_VERSION, PS_NCHAN, count, 0 };
+
+    buffer.clear();
+    buffer.resize(sizeof(header));
+
+    // timestamps as sample intervals, t0 lives in the trailer
+    trailer.t0 = times[0];
+    trailer.t1 = times[count - 1];
+    for (uint32_t i = count - 1; i > 0; i--)
+        times[i] -= times[i - 1];
+    times[0] = 0;
+    encodeColumn(buffer, times, count);
+
+    for (int c = 0; c < PS_NCHAN; c++) {
+        trailer.column[c] = buffer.size() - sizeof(header);
+        encodeColumn(buffer, values[c], count);
+
+        int32_t lo = values[c][0];
+        int32_t hi = values[c][0];
+        int64_t sum = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            lo = min(lo, values[c][i]);
+            hi = max(hi, values[c][i]);
+            sum += values[c][i];
+        }
+        trailer.min[c] = lo * psChannels[c].resolution;
+        trailer.max[c] = hi * psChannels[c].resolution;
+        trailer.sum[c] = sum * (double)psChannels[c].resolution;
+    }
+
+    header.length = buffer.size() - sizeof(header);
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    trailer.magic = PSA_END_MAGIC;
+    trailer.crc = crc32(0, buffer.data(), buffer.size());
+    trailer.crc = crc32(trailer.crc, (const uint8_t *)&trailer, offsetof(psaTrailer, crc));
+    const uint8_t *tp = (const uint8_t *)&trailer;
+    buffer.insert(buffer.end(), tp, tp + sizeof(trailer));
+
+    count = 0;
+
+    // one write per block, back out a short write so the tail stays clean
+    off_t end = lseek(fd, 0, SEEK_END);
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t rc = write(fd, buffer.data() + done, buffer.size() - done);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0) {
+            rc = ftruncate(fd, end);
+            return false;
+        }
+        done += rc;
+    }
+
+    fdatasync(fd);
+    return true;
+}
+
+//******************************************************************
+// Walk the blocks and cut off a block torn by a crash or power cut
+bool PSARCHIVE::repairTail()
+{
+    off_t size = lseek(fd, 0, SEEK_END);
+    off_t pos = 0;
+    off_t last = -1;
+    psaHeader header;
+    psaTrailer tail;
+
+    while (pos + (off_t)sizeof(header) <= size) {
+        if (pread(fd, &header, sizeof(header), pos) != sizeof(header) || header.magic != PSA_MAGIC)
+            break;
+
+        off_t end = pos + sizeof(header) + header.length + sizeof(tail);
+        if (end > size)
+            break;
+        if (pread(fd, &tail, sizeof(tail), end - sizeof(tail)) != sizeof(tail) || tail.magic != PSA_END_MAGIC)
+            break;
+
+        last = pos;
+        pos = end;
+    }
+
+    // only the last whole block can be half on disk, check its crc
+    if (last >= 0 && pos == size) {
+        buffer.resize(pos - last);
+        if (pread(fd, buffer.data(), buffer.size(), last) != (ssize_t)buffer.size())
+            return false;
+
+        uint32_t crc = crc32(0, buffer.data(), buffer.size() - sizeof(tail) + offsetof(psaTrailer, crc));
+        memcpy(&tail, buffer.data() + buffer.size() - sizeof(tail), sizeof(tail));
+        if (crc != tail.crc)
+            pos = last;
+    }
+
+    if (pos < size && (size_t)(size - pos) <= PSA_MAX_BLOCK)
+        return ftruncate(fd, pos) == 0;
+
+    return true;
+}
+
+//******************************************************************
+uint32_t PSARCHIVE::crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    static uint32_t table[256];
+    static bool init = false;
+
+    if ( ! init) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        init = true;
+    }
+
+    crc = ~crc;
+    while (len--)
+        crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+//******************************************************************
+// Reader
+//******************************************************************
+
+//******************************************************************
+PSAREADER::~PSAREADER()
+{
+    close();
+}
+
+//******************************************************************
+bool PSAREADER::open(const char *path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    base = (const uint8_t *)map;
+    size = st.st_size;
+    pos = 0;
+    return true;
+}
+
+//******************************************************************
+void PSAREADER::close()
+{
+    if (base)
+        munmap((void *)base, size);
+    base = nullptr;
+    size = 0;
+}
+
+//******************************************************************
+bool PSAREADER::next(psaBlock &block)
+{
+    static const uint32_t magic = PSA_MAGIC;
+
+    while (pos + sizeof(psaHeader) + sizeof(psaTrailer) <= size) {
+        const psaHeader *header = (const psaHeader *)(base + pos);
+        size_t end = pos + sizeof(psaHeader) + header->length + sizeof(psaTrailer);
+
+        if (header->magic == PSA_MAGIC && header->nchan == PS_NCHAN && header->count > 0
+                && header->length < size && end <= size) {
+            const psaTrailer *trailer = (const psaTrailer *)(base + end - sizeof(psaTrailer));
+            if (trailer->magic == PSA_END_MAGIC) {
+                block.header = header;
+                block.payload = base + pos + sizeof(psaHeader);
+                block.trailer = trailer;
+                pos = end;
+                return true;
+            }
+        }
+
+        // damaged or foreign data, resync on the next block header
+        const void *hit = memmem(base + pos + 1, size - pos - 1, &magic, sizeof(magic));
+        if (hit == nullptr)
+            break;
+        pos = (const uint8_t *)hit - base;
+    }
+
+    pos = size;
+    return false;
+}
+
+//******************************************************************
+bool PSAREADER::times(const psaBlock &block, uint64_t *out)
+{
+    uint32_t n = block.header->count;
+    int64_t *iv = (int64_t *)out;
+
+    if ( ! decodeColumn(block.payload, block.payload + block.trailer->column[0], iv, n))
+        return false;
+
+    uint64_t t = block.trailer->t0;
+    for (uint32_t i = 0; i < n; i++) {
+        t += iv[i];
+        out[i] = t;
+    }
+    return true;
+}
+
+//******************************************************************
+bool PSAREADER::column(const psaBlock &block, int channel, float *out)
+{
+    static vector<int64_t> raw;
+
+    uint32_t n = block.header->count;
+    uint32_t start = block.trailer->column[channel];
+    uint32_t end = (channel + 1 < PS_NCHAN) ? block.trailer->column[channel + 1] : block.header->length;
+
+    if (start > end || end > block.header->length)
+        return false;
+
+    raw.resize(n);
+    if ( ! decodeColumn(block.payload + start, block.payload + end, raw.data(), n))
+        return false;
+
+    float res = psChannels[channel].resolution;
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = raw[i] * res;
+    return true;
+}
@@ -0,0 +1,113 @@
+/***************************************************************
+*  Program:      PSarchive.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star telemetry archive .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <vector>
+
+/*
+ * Append-only columnar archive of getStatus samples.
+ *
+ * The file is a sequence of self contained blocks:
+ *   psaHeader | timestamp column | one column per PS_CHANNEL | psaTrailer
+ *
+ * Every channel is quantized to its psChannels[] resolution and stored as
+ * zigzag varint deltas, with runs of unchanged values collapsed to a single
+ * zero token plus a run length.  Timestamps are stored the same way as
+ * deltas of the sample interval, so a steady poll costs about a byte.
+ *
+ * A block is written with a single write() and the trailer carries a crc32,
+ * so a power cut can only tear the last block.  open() drops a torn tail.
+ */
+
+#define PS_ARCHIVE_FILE     "/var/log/powerstar.psa"
+
+#define PSA_MAGIC           0x42415350      // "PSAB"
+#define PSA_END_MAGIC       0x45415350      // "PSAE"
+#define PSA_VERSION         1
+#define PSA_BLOCK_SAMPLES   900             // 15 min at 1 Hz
+#define PSA_FLUSH_SECS      300             // max age of unwritten samples
+
+#pragma pack(push, 1)
+typedef struct {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t nchan;
+            uint32_t count;                 // samples in this block
+            uint32_t length;                // payload bytes after the header
+} psaHeader;
+
+typedef struct {
+            uint64_t t0;                    // first sample (ms since epoch)
+            uint64_t t1;                    // last sample
+            float    min[PS_NCHAN];
+            float    max[PS_NCHAN];
+            double   sum[PS_NCHAN];
+            uint32_t column[PS_NCHAN];      // channel column offsets in payload
+            uint32_t crc;                   // crc32 of header, payload and trailer to here
+            uint32_t magic;
+} psaTrailer;
+#pragma pack(pop)
+
+class PSARCHIVE
+{
+    public:
+        PSARCHIVE();
+        ~PSARCHIVE();
+
+        bool    open(const char *path);
+        void    close();
+        bool    isOpen() { return fd >= 0; }
+
+        void    append(const psSample &sample);
+        bool    flush();
+
+        static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+    private:
+        bool    repairTail();
+
+        int      fd { -1 };
+        uint32_t count { 0 };
+        uint64_t times[PSA_BLOCK_SAMPLES];
+        int32_t  values[PS_NCHAN][PSA_BLOCK_SAMPLES];
+        int32_t  lastValue[PS_NCHAN];
+        psaTrailer trailer;
+
+        vector<uint8_t> buffer;
+};
+
+// A block as found in a mapped archive
+typedef struct {
+            const psaHeader  *header;
+            const uint8_t    *payload;
+            const psaTrailer *trailer;
+} psaBlock;
+
+class PSAREADER
+{
+    public:
+        PSAREADER() {}
+        ~PSAREADER();
+
+        bool    open(const char *path);
+        void    close();
+
+        // walk the blocks in file order, skipping over damaged data
+        void    rewind() { pos = 0; }
+        bool    next(psaBlock &block);
+
+        // decode a block column into count entries
+        static bool times(const psaBlock &block, uint64_t *out);
+        static bool column(const psaBlock &block, int channel, float *out);
+
+    private:
+        const uint8_t *base { nullptr };
+        size_t  size { 0 };
+        size_t  pos { 0 };
+};
@@ -0,0 +1,153 @@
+/***************************************************************
+*  Program:      PSbudget.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star power budget
+****************************************************************/
+
+#include "PSbudget.h"
+#include "PSports.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+using namespace std;
+
+//******************************************************************
+bool PSBUDGET::open(const char *path, string &error)
+{
+    FILE *fin = fopen(path, "r");
+    if ( ! fin) {
+        error = string("can't read ") + path;
+        return false;
+    }
+
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fin)) {
+        lineNo++;
+        line[strcspn(line, "#\r\n")] = 0;
+
+        char name[32];
+        float value;
+        int n = sscanf(line, " %31s %f", name, &value);
+        if (n <= 0)
+            continue;
+
+        string why;
+        if (n != 2 || value < 0)
+            why = "expected <name> <amps>";
+        else if (strcasecmp(name, "supply") == 0)
+            supply = value;
+        else if (strcasecmp(name, "margin") == 0)
+            margin = value;
+        else if (strcasecmp(name, "defer") == 0)
+            deferMs = value * 1000;
+        else {
+            int port = psPortIndex(name);
+            if (port < 0 || port >= PSE_IN)
+                why = string("unknown port '") + name + "'";
+            else
+                configured[port] = value;
+        }
+
+        if ( ! why.empty()) {
+            error = "line " + to_string(lineNo) + ": " + why;
+            fclose(fin);
+            return false;
+        }
+    }
+    fclose(fin);
+
+    if (supply <= margin) {
+        error = "no supply limit";
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+// The model is the poll, and learned draws follow the peaks down slowly
+void PSBUDGET::update(const psSample &sample)
+{
+    ports = sample.value[PS_CH_PORTS];
+    varSet = sample.value[PS_CH_VAR_SET];
+    in = sample.value[PS_CH_IN_A];
+
+    for (int p = 0; p < PSE_IN; p++) {
+        now[p] = sample.value[PS_CH_OUT1_A + p];
+
+        // share of full on, MP in PWM or dew mode isn't known here
+        float share;
+        if (p == PSE_DEW1 || p == PSE_DEW2)
+            share = sample.value[PS_CH_DEW1_SET + p - PSE_DEW1] / 100;
+        else if (p == PSE_MP && sample.value[PS_CH_MP_MODE] != 0)
+            share = 0;
+        else
+            share = (ports & psPorts[p].mask) ? 1 : 0;
+
+        if (share < 0.05 || now[p] <= 0)
+            continue;
+
+        float full = now[p] / share;
+        if (full > learned[p])
+            learned[p] = full;
+        else
+            learned[p] -= (learned[p] - full) * PSB_DECAY;
+    }
+}
+
+//******************************************************************
+float PSBUDGET::expected(uint8_t port)
+{
+    return configured[port] > 0 ? configured[port] : learned[port];
+}
+
+//******************************************************************
+// Draw of port once the command is done, VAR scales with its voltage
+float PSBUDGET::amps(uint8_t port, PSB_KIND kind, uint16_t value)
+{
+    switch (kind) {
+        case PSB_DEW:
+            return expected(port) * value / 100;
+        case PSB_PWM:
+            return expected(port) * value / 1023;
+        case PSB_VAR:
+            return varSet > 0 ? now[PSE_VAR] * (value / 10.0) / varSet : now[PSE_VAR];
+        default:
+            return expected(port);
+    }
+}
+
+//******************************************************************
+// Until the next poll, assume port draws amps
+void PSBUDGET::book(uint8_t port, float amps)
+{
+    in += amps - now[port];
+    now[port] = amps;
+}
+
+//******************************************************************
+void PSBUDGET::defer(uint8_t port, PSB_KIND kind, uint16_t value)
+{
+    waiting[port].kind = kind;
+    waiting[port].value = value;
+    waiting[port].since = psTimeMs();
+}
+
+//******************************************************************
+bool PSBUDGET::deferred(uint8_t port, psDeferred &cmd)
+{
+    if (waiting[port].kind == PSB_NONE)
+        return false;
+
+    cmd = waiting[port];
+    return true;
+}
+
+//******************************************************************
+bool PSBUDGET::expired(const psDeferred &cmd, uint64_t time)
+{
+    return time - cmd.since > deferMs;
+}
@@ -0,0 +1,95 @@
+/***************************************************************
+*  Program:      PSbudget.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star power budget .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include "PSenergy.h"
+#include <string>
+
+/*
+ * Supply limit and expected port loads, one per line:
+ *
+ *   # comment
+ *   supply  10          amps the supply can give
+ *   margin  0.5         amps kept free, default 0.5
+ *   defer   120         seconds a refused command waits, 0: refuse
+ *   Out1    2.5         full-on amps, Dew and MP at 100%
+ *
+ * The model is the last poll (IN and each port's current) plus whatever
+ * was switched since.  A command that raises a port's draw is let
+ * through only if IN - port now + port after stays under supply - margin,
+ * a few adds with no USB traffic.  Ports without a configured load use
+ * the highest full-on draw seen lately, and pass if never seen.
+ *
+ * A deferred command is kept per port (the newest wins) and retried on
+ * each poll until it fits or its time runs out.
+ */
+
+#define PS_BUDGET_FILE      "/etc/powerstar.budget"
+
+#define PSB_MARGIN          0.5             // amps
+#define PSB_DECAY           0.01            // learned draw, per poll
+#define PSB_NOTES           16
+
+// What a deferred command was
+typedef enum { PSB_NONE,
+               PSB_PORT,                    // port on
+               PSB_DEW,                     // value: %
+               PSB_PWM,                     // value: duty 0-1023
+               PSB_VAR                      // value: setVar units
+} PSB_KIND;
+
+typedef struct {
+            uint8_t  kind;
+            uint16_t value;
+            uint64_t since;                 // ms since epoch
+} psDeferred;
+
+class PSBUDGET
+{
+    public:
+        // parse, error is "line n: why" on failure
+        bool    open(const char *path, string &error);
+
+        // poll path
+        void    update(const psSample &sample);
+
+        // full-on amps of port, configured or learned, 0: unknown
+        float   expected(uint8_t port);
+        float   amps(uint8_t port, PSB_KIND kind, uint16_t value);
+        float   drawing(uint8_t port) { return now[port]; }
+        uint16_t portMask() { return ports; }
+
+        // O(1) admission, delta is the change in the port's draw
+        bool    fits(float delta) { return delta <= 0 || in + delta <= supply - margin; }
+        void    book(uint8_t port, float amps);
+        void    bookPorts(uint16_t mask) { ports = mask; }
+
+        float   load() { return in; }
+        float   limit() { return supply - margin; }
+
+        void    defer(uint8_t port, PSB_KIND kind, uint16_t value);
+        void    cancel(uint8_t port) { waiting[port].kind = PSB_NONE; }
+        bool    deferred(uint8_t port, psDeferred &cmd);
+        bool    expired(const psDeferred &cmd, uint64_t time);
+        bool    defers() { return deferMs > 0; }
+
+    private:
+        float    supply { 0 };
+        float    margin { PSB_MARGIN };
+        uint32_t deferMs { 0 };
+        float    configured[PSE_IN] {};
+        float    learned[PSE_IN] {};
+
+        float    now[PSE_IN] {};
+        float    in { 0 };
+        float    varSet { 0 };
+        uint16_t ports { 0 };
+
+        psDeferred waiting[PSE_IN] {};
+};
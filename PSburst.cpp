@@ -0,0 +1,145 @@
+/***************************************************************
+*  Program:      PSburst.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star burst sampling
+****************************************************************/
+
+#include "PSburst.h"
+#include "PSarchive.h"
+#include <cstdio>
+#include <time.h>
+using namespace std;
+
+static double monoMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+//******************************************************************
+bool PSBURST::burstable(int channel)
+{
+    return (channel >= PS_CH_IN_V && channel <= PS_CH_INT_V)
+        || (channel >= PS_CH_OUT1_A && channel <= PS_CH_IN_A);
+}
+
+//******************************************************************
+bool PSBURST::run(int chan, uint32_t samples, uint32_t ms)
+{
+    if ( ! burstable(chan) || (samples == 0 && ms == 0) || samples > PS_BURST_MAX)
+        return false;
+
+    channel = chan;
+    result = psBurstStats {};
+    if (ms == 0 || ms > PS_BURST_MAX_MS)
+        ms = PS_BURST_MAX_MS;
+
+    // stores land in memory that is already there, unless it outruns the guess
+    uint32_t capacity = samples ? samples : PS_BURST_MAX;
+    buffer.clear();
+    buffer.reserve(min<uint64_t>(capacity, (uint64_t)ms * PS_BURST_RATE / 1000 + 1));
+
+    // the rest of the archive record, and the dew scale for dew currents
+    psctl.getStatus();
+    base = psctl.sample;
+
+    if ( ! psctl.hidBegin())
+        return false;
+
+    bool volts = channel <= PS_CH_INT_V;
+    uint8_t index = volts ? channel - PS_CH_IN_V : channel - PS_CH_OUT1_A;
+    uint32_t n = 0, errors = 0, failing = 0;
+    double worst = 0;
+
+    startTime = psTimeMs();
+    double begin = monoMs(), last = begin;
+    while (n < capacity && last - begin < ms && failing < PS_BURST_ERRORS) {
+        float value;
+        bool ok = volts ? psctl.getVolts(index, &value) : psctl.getCurrent(index, &value);
+        double t = monoMs();
+        if (t - last > worst)
+            worst = t - last;
+        last = t;
+
+        if (ok) {
+            buffer.push_back({ t - begin, value });
+            n++;
+            failing = 0;
+        }
+        else {
+            errors++;
+            failing++;
+        }
+    }
+    psctl.hidEnd();
+
+    result.samples = n;
+    result.errors = errors;
+    result.stopped = failing == PS_BURST_ERRORS;
+    result.seconds = (last - begin) / 1000;
+    result.worstMs = worst;
+    if (n + errors > 0) {
+        result.meanMs = (last - begin) / (n + errors);
+        result.rate = result.meanMs > 0 ? 1000 / result.meanMs : 0;
+    }
+
+    if (n > 0) {
+        double sum = 0;
+        result.min = result.max = buffer[0].value;
+        for (uint32_t i = 0; i < n; i++) {
+            sum += buffer[i].value;
+            result.min = min(result.min, buffer[i].value);
+            result.max = max(result.max, buffer[i].value);
+        }
+        result.mean = sum / n;
+    }
+    return n > 0;
+}
+
+//******************************************************************
+string PSBURST::fileName(const char *ext)
+{
+    time_t secs = startTime / 1000;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    return string(PS_BURST_PREFIX) + stamp + ext;
+}
+
+//******************************************************************
+// time (ms since epoch, to the us) and the channel
+bool PSBURST::writeCsv(const char *path)
+{
+    FILE *fout = fopen(path, "w");
+    if ( ! fout)
+        return false;
+
+    fprintf(fout, "time,%s\n", psChannels[channel].name);
+    for (uint32_t i = 0; i < result.samples; i++)
+        fprintf(fout, "%.3f,%g\n", startTime + buffer[i].ms, buffer[i].value);
+
+    return fclose(fout) == 0;
+}
+
+//******************************************************************
+// One archive record per sample, the archive keeps ms
+bool PSBURST::writeArchive(const char *path)
+{
+    PSARCHIVE archive;
+    if ( ! archive.open(path))
+        return false;
+
+    psSample record = base;
+    for (uint32_t i = 0; i < result.samples; i++) {
+        record.time = startTime + (uint64_t)buffer[i].ms;
+        record.value[channel] = buffer[i].value;
+        archive.append(record);
+    }
+
+    bool ok = archive.flush();
+    archive.close();
+    return ok;
+}
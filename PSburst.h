@@ -0,0 +1,77 @@
+/***************************************************************
+*  Program:      PSburst.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star burst sampling .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <string>
+#include <vector>
+
+/*
+ * Reads one PS_VOLTS or PS_CURRENT channel back to back for a number of
+ * samples or a time, whichever ends first, with the USB held throughout
+ * so nothing else gets in between.  Each reply is timestamped as it
+ * arrives into a buffer sized before the first read (a timed burst's
+ * from PS_BURST_RATE, it grows if the device is faster), so the loop
+ * does nothing but USB and a store.  It gives up after PS_BURST_ERRORS
+ * failed reads in a row, before the watchdog goes past a reopen, and
+ * never runs longer than PS_BURST_MAX_MS.
+ *
+ * Channels are the archive's: IN/Var/Int.volts and the .current ones.
+ * The result can go to a CSV or to its own archive file, where every
+ * other channel is the poll taken just before the burst (psquery -f).
+ */
+
+#define PS_BURST_MAX        1000000         // samples in a burst
+#define PS_BURST_MAX_MS     600000
+#define PS_BURST_RATE       1000            // reads/s expected, sizes a timed burst
+#define PS_BURST_ERRORS     PS_USB_FAIL_MAX // failed reads in a row
+#define PS_BURST_PREFIX     "/var/log/powerstar-burst-"    // + yyyymmdd-hhmmss.csv|.psa
+
+typedef struct {
+            double   ms;                    // reply time after the start
+            float    value;
+} psBurstSample;
+
+typedef struct {
+            uint32_t samples;
+            uint32_t errors;
+            bool     stopped;               // PS_BURST_ERRORS in a row
+            double   seconds;
+            double   rate;                  // commands/s, the device's limit
+            double   meanMs;                // per command
+            double   worstMs;
+            float    min;
+            float    max;
+            float    mean;
+} psBurstStats;
+
+class PSBURST
+{
+    public:
+        PSBURST(PSCTL &ctl) : psctl(ctl) {}
+
+        static bool burstable(int channel);
+
+        // samples 0: until ms, ms 0: until samples
+        bool    run(int channel, uint32_t samples, uint32_t ms);
+
+        const psBurstStats &stats() { return result; }
+        const psBurstSample *data() { return buffer.data(); }
+
+        bool    writeCsv(const char *path);
+        bool    writeArchive(const char *path);
+        string  fileName(const char *ext);  // PS_BURST_PREFIX, start time, ext
+
+    private:
+        PSCTL        &psctl;
+        int           channel { -1 };
+        uint64_t      startTime { 0 };      // ms since epoch
+        psSample      base {};
+        psBurstStats  result {};
+        vector<psBurstSample> buffer;
+};
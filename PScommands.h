@@ -0,0 +1,132 @@
+/***************************************************************
+*  Program:      PScommands.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star command table
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+
+/*
+ * Every opcode PSCTL sends, once (PS_FAST_IN is PS_GET_STATUS, 0x11):
+ *
+ *   request  bytes written, the opcode and the arguments it takes
+ *   reply    bytes of the reply that mean anything, 1: only the echo
+ *   refused  reply bytes (bit n: res[n]) that come back 0xff when the
+ *            device turns a write down
+ *   decode   the reply as a number
+ *
+ * PSCTL's command<>/cached<> look their opcode up here at compile time,
+ * so no call site picks a length or unpacks a reply by hand, and an
+ * opcode missing from the table doesn't build.  psBatch() does the same
+ * for a list of reads sent together (runBatch, the status poll), and
+ * psSend<>() for the commands of a sequence (focusStep, the focuser).
+ */
+
+constexpr uint16_t psLow(const uint8_t *res)  { return res[1]; }
+constexpr uint16_t psHigh(const uint8_t *res) { return res[2]; }
+constexpr uint16_t psWord(const uint8_t *res) { return res[1] | res[2] << 8; }
+
+typedef struct {
+            uint8_t  opcode;
+            uint8_t  request;
+            uint8_t  reply;
+            uint8_t  refused;
+            uint16_t (*decode)(const uint8_t *res);
+} psCommand;
+
+constexpr psCommand psCommands[] = {
+        // focuser
+        { PSCTL::PS_MTR_CMD,      2, 2, 0,    psLow },    // PS_IN .. PS_CMD_MAX, 0: done
+        { PSCTL::PS_GET_STATUS,   1, 2, 0,    psLow },
+        { PSCTL::PS_SET_POS,      3, 3, 0,    psWord },
+        { PSCTL::PS_GET_POS,      2, 3, 0,    psWord },   // PS_ABS or PS_MAX
+        { PSCTL::PS_SET_HBITS,    2, 2, 0x02, psLow },
+        { PSCTL::PS_GET_HBITS,    2, 2, 0,    psLow },
+        { PSCTL::PS_SET_SPERIOD,  2, 2, 0x02, psLow },
+        { PSCTL::PS_GET_SPERIOD,  1, 2, 0,    psLow },
+        { PSCTL::PS_SET_BACKLASH, 3, 3, 0,    psWord },
+        { PSCTL::PS_GET_BACKLASH, 1, 3, 0,    psWord },   // amount, direction
+        { PSCTL::PS_SET_HYS,      2, 2, 0x02, psLow },
+        { PSCTL::PS_GET_HYS,      1, 2, 0,    psLow },
+        { PSCTL::PS_SET_TMPCO,    3, 3, 0,    psWord },
+        { PSCTL::PS_GET_TMPCO,    1, 3, 0,    psWord },   // 8.8 fixed point
+        { PSCTL::PS_SET_TCOMP,    2, 2, 0x02, psLow },
+        { PSCTL::PS_GET_TCOMP,    1, 2, 0,    psLow },
+        { PSCTL::PS_SET_MTRCUR,   3, 3, 0x06, psWord },
+        { PSCTL::PS_GET_MTRCUR,   1, 3, 0,    psWord },   // idle, drive
+        { PSCTL::PS_SET_MTRPOL,   2, 2, 0x02, psLow },
+        { PSCTL::PS_GET_MTRPOL,   1, 2, 0,    psLow },
+        { PSCTL::PS_SET_MTRLCK,   3, 3, 0x02, psWord },   // 0x5a/0xa5/0xaa, value
+        { PSCTL::PS_GET_MTRLCK,   1, 3, 0,    psWord },
+
+        // power
+        { PSCTL::PS_PORT_CTL,     3, 3, 0x06, psWord },
+        { PSCTL::PS_PORT_STATUS,  1, 3, 0,    psWord },
+        { PSCTL::PS_SET_VAR,      2, 2, 0x02, psLow },
+        { PSCTL::PS_GET_VAR,      1, 2, 0,    psLow },    // volts * 10
+        { PSCTL::PS_SET_PWM,      3, 3, 0x04, psWord },
+        { PSCTL::PS_GET_PWM,      1, 3, 0,    psWord },
+        { PSCTL::PS_DEW_CTL,      3, 3, 0x04, psHigh },
+        { PSCTL::PS_DEW_STATUS,   2, 3, 0,    psHigh },   // channel, % in res[2]
+        { PSCTL::PS_VOLTS,        2, 3, 0,    psWord },   // ADC counts
+        { PSCTL::PS_CURRENT,      2, 3, 0,    psWord },
+        { PSCTL::PS_SET_AUTO,     3, 3, 0x04, psWord },
+        { PSCTL::PS_GET_AUTO,     1, 3, 0,    psWord },
+        { PSCTL::PS_SET_MTR_LED,  3, 3, 0x02, psWord },
+        { PSCTL::PS_GET_MTR_LED,  1, 3, 0,    psWord },   // LED/MP, motor type
+        { PSCTL::PS_SET_ULIMIT,   3, 3, 0,    psWord },
+        { PSCTL::PS_GET_ULIMIT,   2, 3, 0,    psWord },
+
+        // device
+        { PSCTL::PS_GET_WEATHER,  2, 3, 0,    psWord },   // PS_TEMP (8.8 C) or PS_HUM
+        { PSCTL::PS_VERSION,      1, 3, 0,    psWord },
+        { PSCTL::PS_FAULT1,       3, 3, 0,    psWord },   // mask
+        { PSCTL::PS_FAULT2,       2, 3, 0,    psWord },   // 1: clear all
+        { PSCTL::PS_RESET,        3, 2, 0x02, psLow }     // 0xa5, 0x5a
+        };
+
+constexpr int PS_NCOMMANDS = sizeof(psCommands) / sizeof(psCommands[0]);
+
+// Index of opcode in psCommands, -1 if it isn't there
+constexpr int psCommandIndex(uint8_t opcode, int i = 0)
+{
+    return i == PS_NCOMMANDS ? -1 : psCommands[i].opcode == opcode ? i : psCommandIndex(opcode, i + 1);
+}
+
+// Longest reply, what a read has to have room for
+constexpr uint8_t psReplyMax(int i = 0, uint8_t most = 0)
+{
+    return i == PS_NCOMMANDS ? most : psReplyMax(i + 1, psCommands[i].reply > most ? psCommands[i].reply : most);
+}
+
+// A read to send as part of a batch
+struct psBatchRead {
+            const psCommand *cmd;
+            uint8_t  arg1;
+            uint8_t  arg2;
+};
+
+// Fails to build for an opcode that isn't in psCommands
+constexpr psBatchRead psBatch(uint8_t opcode, uint8_t arg1 = 0, uint8_t arg2 = 0)
+{
+    return { &psCommands[psCommandIndex(opcode)], arg1, arg2 };
+}
+
+// A command as one step of a sequence; with zero its reply has to
+// decode to 0, as PS_MTR_CMD's does when the motor takes it
+struct psStep {
+            const psCommand *cmd;
+            uint8_t  arg1;
+            uint8_t  arg2;
+            bool     zero;
+};
+
+template <PSCTL::PS_COMMANDS OP>
+constexpr psStep psSend(uint8_t arg1 = 0, uint8_t arg2 = 0, bool zero = false)
+{
+    static_assert(psCommandIndex(OP) >= 0, "opcode missing from psCommands");
+    return { &psCommands[psCommandIndex(OP)], arg1, arg2, zero };
+}
@@ -6,15 +6,33 @@
 ****************************************************************/
 
 #include "PScontrol.h"
+#include "PSarchive.h"
+#include "PSenergy.h"
+#include "PSshm.h"
+#include "PSmetrics.h"
+#include "PSfaults.h"
+#include "PSrecorder.h"
+#include "PSrules.h"
+#include "PSjournal.h"
+#include "PSbudget.h"
+#include "PScommands.h"
+#include "PSports.h"
 #include <boost/algorithm/string.hpp>
 #include <cmath>
 #include <cstring>
+#include <strings.h>
 #include <memory>
 #include <iostream>
 #include <algorithm>
 #include <iterator>
 #include <string>
 #include <bits/stdc++.h> 
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 using namespace std;
 
 
@@ -34,23 +52,98 @@ const std::map<PS_MOTOR, std::string> PSCTL::MotorMap =
 };
 **/
 
- map<string, uint16_t> devmask{ 
-        { "out1", 0x0001 }, 
-        { "out2", 0x0002 }, 
-        { "out3", 0x0004 }, 
-        { "out4", 0x0008 },
-        { "var",  0x0040 },
-        { "mp",   0x0080 },
-        
-        { "usb1", 0x0100 },
-        { "usb2", 0x0200 },
-        { "usb3", 0x0400 },
-        { "usb4", 0x0800 },
-        { "usb5", 0x1000 },
-        { "usb6", 0x2000 },
-        { "all",  0xfffe }
-        }; 
-    map<string, uint8_t>::iterator i;
+const char *psUsbStates[PS_USB_LOST + 1] = { "OK", "Reopening", "Resetting USB port", "Restarting Power*Star", "Lost" };
+
+//******************************************************************
+uint64_t psTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// PS_VOLTS channels IN, Var, Int
+static constexpr float voltScale[3] = { psVoltScale(0), psVoltScale(1), psVoltScale(2) };
+
+//******************************************************************
+// Dew heaters read their full-on current, scale by the setting
+static float portAmps(uint8_t port, uint16_t counts, const psSample &sample)
+{
+    float amps = counts * psPorts[port].ampScale;
+    if (port == PSE_DEW1)
+        amps = amps / 100 * sample.value[PS_CH_DEW1_SET];
+    else if (port == PSE_DEW2)
+        amps = amps / 100 * sample.value[PS_CH_DEW2_SET];
+    return amps;
+}
+
+//******************************************************************
+// Typed commands, see PScommands.h
+//******************************************************************
+
+//******************************************************************
+// Answered and not turned down, then decoded
+static inline bool commandOk(const psCommand &cmd, const uint8_t *res, uint16_t *value)
+{
+    if (res[0] == 0xff)
+        return false;
+    if (((cmd.refused & 0x02) && res[1] == 0xff) || ((cmd.refused & 0x04) && res[2] == 0xff))
+        return false;
+    if (value)
+        *value = cmd.decode(res);
+    return true;
+}
+
+//******************************************************************
+template <PSCTL::PS_COMMANDS OP>
+bool PSCTL::command(uint8_t hidArg1, uint8_t hidArg2, uint16_t *value)
+{
+    static_assert(psCommandIndex(OP) >= 0, "opcode missing from psCommands");
+    constexpr psCommand cmd = psCommands[psCommandIndex(OP)];
+    
+    response = hidCMD(OP, hidArg1, hidArg2, cmd.request);
+    return commandOk(cmd, response, value);
+}
+
+//******************************************************************
+// Through the read cache
+template <PSCTL::PS_COMMANDS OP>
+bool PSCTL::cached(uint8_t hidArg1, uint8_t hidArg2, uint16_t *value)
+{
+    static_assert(psCommandIndex(OP) >= 0, "opcode missing from psCommands");
+    constexpr psCommand cmd = psCommands[psCommandIndex(OP)];
+    
+    response = hidRead(OP, hidArg1, hidArg2, cmd.request);
+    return commandOk(cmd, response, value);
+}
+
+//******************************************************************
+// Every read of plan (with select, those with their bit set) in one
+// USB session, with cache the fresh ones from the read cache; bit i set
+// if read i was answered, values[i] is left alone if not
+template <size_t N>
+uint32_t PSCTL::runBatch(const psBatchRead (&plan)[N], uint16_t (&values)[N], bool cache, uint32_t select)
+{
+    static_assert(N <= 32, "one answered bit per read");
+    uint32_t answered = 0;
+    
+    bool session = hidBegin();
+    for (size_t i = 0; i < N; i++) {
+        if ( ! (select >> i & 1))
+            continue;
+        const psCommand &cmd = *plan[i].cmd;
+        if (cache)
+            response = hidRead((PS_COMMANDS)cmd.opcode, plan[i].arg1, plan[i].arg2, cmd.request);
+        else
+            response = hidCMD((PS_COMMANDS)cmd.opcode, plan[i].arg1, plan[i].arg2, cmd.request);
+        if (commandOk(cmd, response, &values[i]))
+            answered |= 1u << i;
+    }
+    if (session)
+        hidEnd();
+    
+    return answered;
+}
 
 //******************************************************************
 bool PSCTL::Connect()
@@ -63,9 +156,16 @@ bool PSCTL::Connect()
     // Close the USB (we only connected to test)
     hid_close(handle);
     hid_exit();
+    handle = nullptr;
     
     unLockFocusMtr();
 
+    // start from what the device has, not what we had last time
+    dropCached();
+    uint8_t lo, hi;
+    for (int reg = 0; reg < PS_NREGS; reg++)
+        getRegister((PS_REGISTER)reg, &lo, &hi);
+
     return true;
 }
 
@@ -73,10 +173,566 @@ bool PSCTL::Connect()
 bool PSCTL::Disconnect()
 {
     lockFocusMtr();
+    closeArchive();
+    closeEnergy();
+    closeShared();
+    closeMetrics();
+    closeRecorder();
+    closeRules();
+    closeJournal();
+    closeBudget();
     isConnected = false;
     return true;
 }
 
+//******************************************************************
+bool PSCTL::openArchive(const char *path)
+{
+    closeArchive();
+    
+    archive = new PSARCHIVE();
+    if ( ! archive->open(path)) {
+        delete archive;
+        archive = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeArchive()
+{
+    if (archive == nullptr)
+        return;
+    
+    archive->close();
+    delete archive;
+    archive = nullptr;
+}
+
+//******************************************************************
+bool PSCTL::openEnergy(const char *path)
+{
+    closeEnergy();
+    
+    // only the process doing the polling can integrate
+    if (shared && ! shared->isOwner())
+        return false;
+    
+    energy = new PSENERGY();
+    if ( ! energy->open(path)) {
+        delete energy;
+        energy = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeEnergy()
+{
+    if (energy == nullptr)
+        return;
+    
+    energy->close();
+    delete energy;
+    energy = nullptr;
+}
+
+//******************************************************************
+bool PSCTL::openShared()
+{
+    closeShared();
+    
+    shared = new PSSHARED();
+    if ( ! shared->open()) {
+        delete shared;
+        shared = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeShared()
+{
+    if (shared == nullptr)
+        return;
+    
+    shared->close();
+    delete shared;
+    shared = nullptr;
+}
+
+//******************************************************************
+bool PSCTL::sharedReader()
+{
+    return shared != nullptr && ! shared->isOwner();
+}
+
+//******************************************************************
+bool PSCTL::openMetrics(const char *listen)
+{
+    closeMetrics();
+    
+    metrics = new PSMETRICS();
+    if ( ! metrics->start(listen)) {
+        delete metrics;
+        metrics = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeMetrics()
+{
+    if (metrics == nullptr)
+        return;
+    
+    metrics->stop();
+    delete metrics;
+    metrics = nullptr;
+}
+
+//******************************************************************
+bool PSCTL::openRecorder(const char *dir)
+{
+    closeRecorder();
+    
+    recorder = new PSRECORDER();
+    if ( ! recorder->open(dir)) {
+        delete recorder;
+        recorder = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeRecorder()
+{
+    if (recorder == nullptr)
+        return;
+    
+    recorder->close();
+    delete recorder;
+    recorder = nullptr;
+}
+
+//******************************************************************
+bool PSCTL::nextCapture(string &path)
+{
+    return recorder && recorder->nextCapture(path);
+}
+
+//******************************************************************
+bool PSCTL::openRules(const char *path, string &error)
+{
+    closeRules();
+    
+    rules = new PSRULES();
+    if ( ! rules->open(path, error)) {
+        delete rules;
+        rules = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeRules()
+{
+    if (rules == nullptr)
+        return;
+    
+    delete rules;
+    rules = nullptr;
+}
+
+//******************************************************************
+bool PSCTL::openJournal(const char *path)
+{
+    closeJournal();
+    
+    journal = new PSJOURNAL();
+    if ( ! journal->open(path)) {
+        delete journal;
+        journal = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeJournal()
+{
+    delete journal;
+    journal = nullptr;
+    restorePending = false;
+}
+
+//******************************************************************
+// What restoreState put back since the last call
+bool PSCTL::nextRestore(string &what)
+{
+    if (restored.empty())
+        return false;
+    
+    what = restored;
+    restored.clear();
+    return true;
+}
+
+//******************************************************************
+bool PSCTL::openBudget(const char *path, string &error)
+{
+    closeBudget();
+    
+    budget = new PSBUDGET();
+    if ( ! budget->open(path, error)) {
+        delete budget;
+        budget = nullptr;
+        return false;
+    }
+    if (sample.time)
+        budget->update(sample);
+    return true;
+}
+
+//******************************************************************
+void PSCTL::closeBudget()
+{
+    delete budget;
+    budget = nullptr;
+    budgetNotes.clear();
+}
+
+//******************************************************************
+// Refused, deferred and late commands, oldest first
+bool PSCTL::nextBudgetNote(string &note)
+{
+    if (budgetNotes.empty())
+        return false;
+    
+    note = budgetNotes.front();
+    budgetNotes.pop_front();
+    return true;
+}
+
+//******************************************************************
+void PSCTL::budgetNote(const string &note)
+{
+    if (budgetNotes.size() >= PSB_NOTES)
+        budgetNotes.pop_front();
+    budgetNotes.push_back(note);
+}
+
+//******************************************************************
+// Lets port's draw after the command through if it fits the budget,
+// books it so the next check sees it before the next poll does
+bool PSCTL::admit(uint8_t port, int kind, uint16_t value)
+{
+    float amps = budget->amps(port, (PSB_KIND)kind, value);
+    float delta = amps - budget->drawing(port);
+    
+    if (budget->fits(delta)) {
+        budget->cancel(port);
+        budget->book(port, amps);
+        return true;
+    }
+    
+    char note[128];
+    snprintf(note, sizeof(note), "%s %s: %.1f A more on %.1f A is over the %.1f A budget",
+             psPorts[port].name, budget->defers() ? "deferred" : "refused",
+             delta, budget->load(), budget->limit());
+    budgetNote(note);
+    
+    if (budget->defers())
+        budget->defer(port, (PSB_KIND)kind, value);
+    return false;
+}
+
+//******************************************************************
+// Deferred commands go out once they fit, or are dropped when too old
+void PSCTL::retryDeferred()
+{
+    uint64_t time = psTimeMs();
+    psDeferred cmd;
+    
+    for (uint8_t port = 0; port < PSE_IN; port++) {
+        if ( ! budget->deferred(port, cmd))
+            continue;
+        
+        string name = psPorts[port].name;
+        float amps = budget->amps(port, (PSB_KIND)cmd.kind, cmd.value);
+        if ( ! budget->fits(amps - budget->drawing(port))) {
+            if (budget->expired(cmd, time)) {
+                budget->cancel(port);
+                budgetNote(name + " dropped, still over budget");
+            }
+            continue;
+        }
+        
+        bool ok;
+        uint16_t ports, refused;
+        switch (cmd.kind) {
+            case PSB_PORT:
+                ok = getPortStatus(&ports) && setPortStatus(ports | psPorts[port].mask, &refused) && ! refused;
+                break;
+            case PSB_DEW:
+                ok = setDew(port == PSE_MP ? 2 : port - PSE_DEW1, cmd.value);
+                break;
+            case PSB_PWM:
+                ok = setPWM(cmd.value);
+                break;
+            default:
+                ok = setVar(cmd.value);
+        }
+        budget->cancel(port);
+        budgetNote(name + (ok ? " applied after " + to_string((time - cmd.since) / 1000) + " s" : " failed"));
+    }
+}
+
+//******************************************************************
+// Counters from our own meter, or from the owner's segment
+bool PSCTL::getEnergy(double *ah, double *wh, uint64_t *since)
+{
+    if (energy) {
+        for (int p = 0; p < PSE_NPORTS; p++) {
+            ah[p] = energy->ampHours(p);
+            wh[p] = energy->wattHours(p);
+        }
+        *since = energy->since();
+        return true;
+    }
+    
+    if (shared && ! shared->isOwner())
+        return shared->energy(ah, wh, since);
+    
+    return false;
+}
+
+//******************************************************************
+// Register shadows
+//******************************************************************
+
+static bool usbElsewhere();
+
+//******************************************************************
+// A register from its shadow, or from the device if that is too old or
+// another process (pstui, the driver) has been at the Power*Star since
+bool PSCTL::getRegister(PS_REGISTER reg, uint8_t *lo, uint8_t *hi)
+{
+    if (shadow[reg].time == 0 || psTimeMs() - shadow[reg].time > PS_SHADOW_MS || usbElsewhere()) {
+        bool ok = reg == PS_REG_PORTS ? command<PS_PORT_STATUS>()
+                : reg == PS_REG_AUTO ? command<PS_GET_AUTO>()
+                : command<PS_GET_MTR_LED>();
+        if ( ! ok)
+            return false;
+    }
+    
+    *lo = shadow[reg].lo;
+    *hi = shadow[reg].hi;
+    return true;
+}
+
+//******************************************************************
+// Every answered read or write of a shadowed register goes through here
+void PSCTL::shadowCommand(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, const uint8_t *res)
+{
+    PS_REGISTER reg;
+    bool write = false;
+    
+    switch (hcmd) {
+        case PS_PORT_STATUS:    reg = PS_REG_PORTS; break;
+        case PS_PORT_CTL:       reg = PS_REG_PORTS; write = true; break;
+        case PS_GET_AUTO:       reg = PS_REG_AUTO; break;
+        case PS_SET_AUTO:       reg = PS_REG_AUTO; write = true; break;
+        case PS_GET_MTR_LED:    reg = PS_REG_MTR_LED; break;
+        case PS_SET_MTR_LED:    reg = PS_REG_MTR_LED; write = true; break;
+        default:                return;
+    }
+    
+    // a refused write leaves the device as it was, and maybe us not knowing
+    if (write && (res[1] == 0xff || res[2] == 0xff)) {
+        shadow[reg].time = 0;
+        return;
+    }
+    
+    shadow[reg].lo = write ? hidArg1 : res[1];
+    shadow[reg].hi = write ? hidArg2 : res[2];
+    shadow[reg].time = psTimeMs();
+}
+
+//******************************************************************
+// A reader's shadows come from the owner's poll
+void PSCTL::shadowSample()
+{
+    uint16_t ports = sample.value[PS_CH_PORTS];
+    uint16_t autoboot = sample.value[PS_CH_AUTOBOOT];
+    uint8_t  mtrLed = ((uint8_t)sample.value[PS_CH_LED] << 4) | (uint8_t)sample.value[PS_CH_MP_MODE]
+                      | (shadow[PS_REG_MTR_LED].lo & 0x0c);
+    
+    shadow[PS_REG_PORTS] = { (uint8_t)(ports & 0xff), (uint8_t)(ports >> 8), sample.time };
+    shadow[PS_REG_AUTO] = { (uint8_t)(autoboot & 0xff), (uint8_t)(autoboot >> 8), sample.time };
+    shadow[PS_REG_MTR_LED] = { mtrLed, (uint8_t)sample.value[PS_CH_FM], sample.time };
+}
+
+//******************************************************************
+// Shadows and cached reads both
+void PSCTL::dropCached()
+{
+    for (int reg = 0; reg < PS_NREGS; reg++)
+        shadow[reg].time = 0;
+    readCache.clear();
+    
+    // it may have come up with the motor locked
+    brakingSent = -1;
+}
+
+//******************************************************************
+// How long an answered read stays good, 0: always ask the device
+static uint32_t cacheTtl(uint8_t hcmd)
+{
+    switch (hcmd) {
+        case PSCTL::PS_PORT_STATUS:
+        case PSCTL::PS_DEW_STATUS:
+        case PSCTL::PS_VOLTS:
+        case PSCTL::PS_CURRENT:
+        case PSCTL::PS_GET_AUTO:
+        case PSCTL::PS_GET_VAR:
+        case PSCTL::PS_GET_PWM:
+        case PSCTL::PS_GET_MTR_LED:
+            return PS_CACHE_STATUS_MS;
+            
+        case PSCTL::PS_FAULT1:
+        case PSCTL::PS_FAULT2:
+            return PS_CACHE_FAULT_MS;
+            
+        case PSCTL::PS_GET_SPERIOD:
+        case PSCTL::PS_GET_BACKLASH:
+        case PSCTL::PS_GET_HYS:
+        case PSCTL::PS_GET_TMPCO:
+        case PSCTL::PS_GET_TCOMP:
+        case PSCTL::PS_GET_MTRCUR:
+        case PSCTL::PS_GET_MTRPOL:
+        case PSCTL::PS_GET_MTRLCK:
+        case PSCTL::PS_GET_ULIMIT:
+        case PSCTL::PS_GET_WEATHER:
+            return PS_CACHE_SETUP_MS;
+            
+        case PSCTL::PS_VERSION:
+            return PS_CACHE_VERSION_MS;
+            
+        default:
+            return 0;
+    }
+}
+
+//******************************************************************
+// A read from memory while it is fresh, from the device otherwise
+uint8_t* PSCTL::hidRead(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd)
+{
+    auto hit = readCache.find(hcmd << 16 | hidArg1 << 8 | hidArg2);
+    if (hit != readCache.end() && psTimeMs() - hit->second.time <= cacheTtl(hcmd)) {
+        memcpy(cacheReply, hit->second.res, sizeof(cacheReply));
+        return cacheReply;
+    }
+    
+    return hidCMD(hcmd, hidArg1, hidArg2, numCmd);
+}
+
+//******************************************************************
+// Every answered command: keep the reads, drop what a write makes stale
+void PSCTL::cacheCommand(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, const uint8_t *res)
+{
+    // PS_FAULT2 with an argument clears the faults
+    bool clear = hcmd == PS_FAULT2 && hidArg1 != 0;
+    
+    if (cacheTtl(hcmd) && ! clear) {
+        psCached &entry = readCache[hcmd << 16 | hidArg1 << 8 | hidArg2];
+        memcpy(entry.res, res, sizeof(entry.res));
+        entry.time = psTimeMs();
+        return;
+    }
+    
+    // a user limit only makes its own read stale
+    if (hcmd == PS_SET_ULIMIT) {
+        readCache.erase(PS_GET_ULIMIT << 16 | hidArg1 << 8);
+        return;
+    }
+    
+    // setters are one below their getter
+    if (cacheTtl(hcmd + 1))
+        dropReads(hcmd + 1);
+    
+    switch (hcmd) {
+        case PS_FAULT2:
+            dropReads(PS_FAULT1);
+            dropReads(PS_FAULT2);
+            break;
+        
+        // what the ports draw
+        case PS_PORT_CTL:
+        case PS_DEW_CTL:
+        case PS_SET_VAR:
+        case PS_SET_PWM:
+        case PS_SET_MTR_LED:
+            dropReads(PS_CURRENT);
+            dropReads(PS_VOLTS);
+            break;
+        
+        default:
+            break;
+    }
+}
+
+//******************************************************************
+void PSCTL::dropReads(uint8_t hcmd)
+{
+    readCache.erase(readCache.lower_bound(hcmd << 16), readCache.lower_bound((hcmd + 1) << 16));
+}
+
+//******************************************************************
+// Every answered command: note the writes the next NVM commit saves
+void PSCTL::nvmCommand(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2)
+{
+    switch (hcmd) {
+        case PS_SET_SPERIOD:
+        case PS_SET_BACKLASH:
+        case PS_SET_HYS:
+        case PS_SET_TMPCO:
+        case PS_SET_TCOMP:
+        case PS_SET_MTRCUR:
+        case PS_SET_MTRPOL:
+        case PS_SET_MTR_LED:
+        case PS_SET_ULIMIT:
+        case PS_SET_PWM:
+        case PS_SET_AUTO:
+        case PS_SET_VAR:
+        case PS_DEW_CTL:
+            nvmDirty = true;
+            break;
+        
+        // 0x5a unlock with a braking level, 0xa5 lock, 0xaa commit
+        case PS_SET_MTRLCK:
+            if (hidArg1 == 0xaa)
+                nvmDirty = false;
+            else if (hidArg1 == 0x5a) {
+                if (brakingSent >= 0 && brakingSent != hidArg2)
+                    nvmDirty = true;
+                brakingSent = hidArg2;
+            }
+            else
+                brakingSent = -1;
+            break;
+        
+        default:
+            break;
+    }
+}
+
 //******************************************************************
 // Get Device Status
 //******************************************************************
@@ -85,345 +741,599 @@ bool PSCTL::Disconnect()
 // Reports whether ports or usb are on or off
 bool PSCTL::getStatus()
 {
-    // Port Status
-    response = hidCMD(PS_PORT_STATUS, 0x00, 0x00, 3);
+    // another process owns the Power*Star, use its last poll
+    if (shared && ! shared->isOwner()) {
+        uint64_t last = sample.time;
+        if (shared->live() && shared->latest(sample)) {
+            loadStatus();
+            if (archive && sample.time != last)
+                archive->append(sample);
+            if (recorder && sample.time != last)
+                recorder->record(sample);
+            if (rules && sample.time != last)
+                rules->evaluate(sample, faults);
+            if (sample.time != last)
+                shadowSample();
+            if (budget && sample.time != last) {
+                budget->update(sample);
+                retryDeferred();
+            }
+            if (metrics)
+                metrics->setStatus(sample);
+            return true;
+        }
         
-    statusMap["Out1"].state = (response[1] & 0x01);
-    statusMap["USB1"].state = (response[2] & 0x01);
-    statusMap["Out2"].state = (response[1] & 0x02);
-    statusMap["USB2"].state = (response[2] & 0x02);
-    statusMap["Out3"].state = (response[1] & 0x04);
-    statusMap["USB3"].state = (response[2] & 0x04);
-    statusMap["Out4"].state = (response[1] & 0x08);
-    statusMap["USB4"].state = (response[2] & 0x08);
-    statusMap["Var"].state = (response[1] & 0x40);
-    statusMap["USB5"].state = (response[2] & 0x10);
-    statusMap["MP"].state = (response[1] & 0x80);
-    statusMap["USB6"].state = (response[2] & 0x20);
-
-    // Dew
-    response = hidCMD(PS_DEW_STATUS, 0x00, 0x00, 3);
-    statusMap["Dew1"].setting = response[2];
-    statusMap["Dew1"].state = (response[2] > 0);
-    
-    response = hidCMD(PS_DEW_STATUS, 0x01, 0x00, 3);
-    statusMap["Dew2"].setting = response[2];
-    statusMap["Dew2"].state = (response[2] > 0);
-
-    // Voltages
-    response = hidCMD(PS_VOLTS, 0, 0x00, 3);
-    float INvolts = (response[2] * 256 + response[1]) * 0.014695;
-    statusMap["IN"].levels = INvolts;
-    
-    response = hidCMD(PS_VOLTS, 1, 0x00, 3);
-    float VARvolts = (response[2] * 256 + response[1]) * 0.012813;
-    statusMap["Var"].levels = VARvolts;
-    
-    response = hidCMD(PS_VOLTS, 2, 0x00, 3);
-    float INTvolts = (response[2] * 256 + response[1]) * 0.004004;
-    statusMap["Int"].levels = INTvolts;
-    
-    // Port Currents
-    response = hidCMD(PS_CURRENT, 0, 0x00, 3);
-    statusMap["Out1"].current = (response[2] * 256 + response[1]) * 0.075690;
-    response = hidCMD(PS_CURRENT, 1, 0x00, 3);
-    statusMap["Out2"].current = (response[2] * 256 + response[1]) * 0.075690;
-    response = hidCMD(PS_CURRENT, 2, 0x00, 3);
-    statusMap["Out3"].current = (response[2] * 256 + response[1]) * 0.010111;
-    response = hidCMD(PS_CURRENT, 3, 0x00, 3);
-    statusMap["Out4"].current = (response[2] * 256 + response[1]) * 0.010111;
-    
-    //Dew
-    response = hidCMD(PS_CURRENT, 4, 0x00, 3);
-    statusMap["Dew1"].current = ((response[2] * 256 + response[1]) * 0.010111) / 100  * statusMap["Dew1"].setting;
-    response = hidCMD(PS_CURRENT, 5, 0x00, 3);
-    statusMap["Dew2"].current = ((response[2] * 256 + response[1]) * 0.010111) / 100 * statusMap["Dew2"].setting;
-    
-    response = hidCMD(PS_CURRENT, 6, 0x00, 3);
-    statusMap["Var"].current = (response[2] * 256 + response[1]) * 0.010111;
-    response = hidCMD(PS_CURRENT, 7, 0x00, 3);
-    statusMap["MP"].current = (response[2] * 256 + response[1]) * 0.010111;
-
-    response = hidCMD(PS_CURRENT, 8, 0x00, 3);
-    statusMap["IN"].current = (response[2] * 256 + response[1]) * 0.001780;
-    
-    // Temperature
-    response = hidCMD(PS_GET_WEATHER, PS_TEMP, 0x00, 3);
-    float curTemp = ((response[2] * 256 + response[1]) / 256) * 9 / 5.0 + 32; // in F
-    statusMap["Temp"].levels = curTemp;
-
-    // Humidity
-    response = hidCMD(PS_GET_WEATHER, PS_HUM, 0x00, 3);
-    statusMap["Hum"].levels = response[1];
-
-    // autoboot
-    response = hidCMD(PS_GET_AUTO, 0x00, 0x00, 3);
-    
-    statusMap["Out1"].autoboot = (response[1] & 0x01);
-    statusMap["Out2"].autoboot = (response[1] & 0x02);
-    statusMap["Out3"].autoboot = (response[1] & 0x04);
-    statusMap["Out4"].autoboot = (response[1] & 0x08);
-    statusMap["Dew1"].autoboot = (response[1] & 0x10);
-    statusMap["Dew2"].autoboot = (response[1] & 0x20);
-    statusMap["Var"].autoboot = (response[1] & 0x40);
-    statusMap["MP"].autoboot = (response[1] & 0x80);
-    statusMap["USB1"].autoboot = (response[2] & 0x01);
-    statusMap["USB2"].autoboot = (response[2] & 0x02);
-    statusMap["USB3"].autoboot = (response[2] & 0x04);
-    statusMap["USB4"].autoboot = (response[2] & 0x08);
-    statusMap["USB5"].autoboot = (response[2] & 0x10);
-    statusMap["USB6"].autoboot = (response[2] & 0x20);
-    
-    // Variable Out
-    response = hidCMD(PS_GET_VAR, 0x00, 0x00, 1);
-    statusMap["Var"].levels = response[1] / 10.0;
-
-    // Multiport
-    response = hidCMD(PS_GET_MTR_LED, 0x00, 0x00, 3);
-    statusMap["MP"].setting = response[1] & 0x03;
-    statusMap["LED"].setting = (response[1] % 0xf0) >> 4;
-    statusMap["FM"].setting = response[2];
+        // owner gone or idle, take over if we can
+        shared->open();
+    }
+    
+    // The poll, read in this order in one USB session
+    enum { POLL_PORTS, POLL_DEW1, POLL_DEW2, POLL_VOLTS,
+           POLL_AMPS = POLL_VOLTS + 3,
+           POLL_TEMP = POLL_AMPS + PSE_NPORTS, POLL_HUM, POLL_AUTO, POLL_VAR, POLL_MTR_LED,
+           POLL_READS };
+    static constexpr psBatchRead poll[] = {
+        psBatch(PS_PORT_STATUS),
+        psBatch(PS_DEW_STATUS, 0), psBatch(PS_DEW_STATUS, 1),
+        psBatch(PS_VOLTS, 0), psBatch(PS_VOLTS, 1), psBatch(PS_VOLTS, 2),
+        psBatch(PS_CURRENT, PSE_OUT1), psBatch(PS_CURRENT, PSE_OUT2),
+        psBatch(PS_CURRENT, PSE_OUT3), psBatch(PS_CURRENT, PSE_OUT4),
+        psBatch(PS_CURRENT, PSE_DEW1), psBatch(PS_CURRENT, PSE_DEW2),
+        psBatch(PS_CURRENT, PSE_VAR), psBatch(PS_CURRENT, PSE_MP),
+        psBatch(PS_CURRENT, PSE_IN),
+        psBatch(PS_GET_WEATHER, PS_TEMP), psBatch(PS_GET_WEATHER, PS_HUM),
+        psBatch(PS_GET_AUTO), psBatch(PS_GET_VAR), psBatch(PS_GET_MTR_LED)
+        };
+    static_assert(sizeof(poll) / sizeof(poll[0]) == POLL_READS, "poll plan and POLL_ out of step");
+    
+    // a read that goes unanswered leaves its channels as they were
+    uint16_t raw[POLL_READS];
+    uint32_t answered = runBatch(poll, raw);
+    auto got = [answered](int read) { return (answered >> read) & 1; };
+    
+    if (got(POLL_PORTS))
+        sample.value[PS_CH_PORTS] = raw[POLL_PORTS];
+    if (got(POLL_DEW1))
+        sample.value[PS_CH_DEW1_SET] = raw[POLL_DEW1];
+    if (got(POLL_DEW2))
+        sample.value[PS_CH_DEW2_SET] = raw[POLL_DEW2];
+    
+    for (uint8_t channel = 0; channel < 3; channel++)
+        if (got(POLL_VOLTS + channel))
+            sample.value[PS_CH_IN_V + channel] = raw[POLL_VOLTS + channel] * voltScale[channel];
+    
+    // after the dew settings, the dew currents are scaled by them
+    for (uint8_t port = PSE_OUT1; port < PSE_NPORTS; port++)
+        if (got(POLL_AMPS + port))
+            sample.value[PS_CH_OUT1_A + port] = portAmps(port, raw[POLL_AMPS + port], sample);
+    
+    if (got(POLL_TEMP))
+        sample.value[PS_CH_TEMP] = (raw[POLL_TEMP] / 256) * 9 / 5.0 + 32; // in F
+    if (got(POLL_HUM))
+        sample.value[PS_CH_HUM] = raw[POLL_HUM] & 0xff;
+    if (got(POLL_AUTO))
+        sample.value[PS_CH_AUTOBOOT] = raw[POLL_AUTO];
+    if (got(POLL_VAR))
+        sample.value[PS_CH_VAR_SET] = raw[POLL_VAR] / 10.0;
+    if (got(POLL_MTR_LED)) {
+        sample.value[PS_CH_MP_MODE] = raw[POLL_MTR_LED] & 0x03;
+        sample.value[PS_CH_LED] = ((raw[POLL_MTR_LED] & 0xff) % 0xf0) >> 4;
+        sample.value[PS_CH_FM] = raw[POLL_MTR_LED] >> 8;
+    }
+    
+    if (journal && restorePending && usb == PS_USB_OK)
+        restoreState();
+    
+    sample.time = psTimeMs();
+    loadStatus();
+    
+    if (archive)
+        archive->append(sample);
+    if (energy)
+        energy->update(sample);
+    if (recorder)
+        recorder->record(sample);
+    if (rules)
+        rules->evaluate(sample, faults);
+    if (budget) {
+        budget->update(sample);
+        retryDeferred();
+    }
+    if (shared)
+        shared->publish(sample, energy);
+    if (metrics)
+        metrics->setStatus(sample);
     
     return true;
 }
 
 //******************************************************************
+// Puts back what the journal wants and the reset lost, in one USB session
+void PSCTL::restoreState()
+{
+    restorePending = false;
+    if ( ! journal->load())
+        return;
+    
+    const psState &want = journal->desired();
+    string what;
+    bool session = hidBegin();
+    
+    uint16_t ports = want.ports & ~0xc030;
+    if ((want.known & PSJ_PORTS) && ports != ((uint16_t)sample.value[PS_CH_PORTS] & ~0xc030)) {
+        if (command<PS_PORT_CTL>(ports & 0xff, ports >> 8)) {
+            sample.value[PS_CH_PORTS] = ports;
+            what += "ports ";
+        }
+    }
+    
+    for (uint8_t ch = 0; ch < 2; ch++) {
+        if ( ! (want.known & (ch == 0 ? PSJ_DEW1 : PSJ_DEW2)) || want.dew[ch] == sample.value[PS_CH_DEW1_SET + ch])
+            continue;
+        if (command<PS_DEW_CTL>(ch, want.dew[ch])) {
+            sample.value[PS_CH_DEW1_SET + ch] = want.dew[ch];
+            what += ch == 0 ? "Dew1 " : "Dew2 ";
+        }
+    }
+    
+    if ((want.known & PSJ_VAR) && want.var != lround(sample.value[PS_CH_VAR_SET] * 10)) {
+        if (command<PS_SET_VAR>(want.var)) {
+            sample.value[PS_CH_VAR_SET] = want.var / 10.0;
+            what += "VAR ";
+        }
+    }
+    
+    // LED and multiport share one register, one write for both
+    uint8_t led = (want.known & PSJ_LED) ? want.led : sample.value[PS_CH_LED];
+    uint8_t mp = (want.known & PSJ_MP) ? want.mpMode : sample.value[PS_CH_MP_MODE];
+    if (led != sample.value[PS_CH_LED] || mp != sample.value[PS_CH_MP_MODE]) {
+        if (command<PS_SET_MTR_LED>((led << 4) | (mp & 0x0f), sample.value[PS_CH_FM])) {
+            sample.value[PS_CH_LED] = led;
+            sample.value[PS_CH_MP_MODE] = mp;
+            what += "LED/MP ";
+        }
+    }
+    
+    if (session)
+        hidEnd();
+    
+    if ( ! what.empty())
+        restored = what.substr(0, what.size() - 1);
+}
+
+//******************************************************************
+// statusMap view of the latest sample
+void PSCTL::loadStatus()
+{
+    // the ports' entries, looked up once
+    if (portData.empty())
+        for (int p = 0; p < PSP_NPORTS; p++)
+            portData.push_back(&statusMap[psPorts[p].name]);
+    
+    uint16_t ports = sample.value[PS_CH_PORTS];
+    uint16_t autoboot = sample.value[PS_CH_AUTOBOOT];
+    for (int p = 0; p < PSP_NPORTS; p++) {
+        const psPort &port = psPorts[p];
+        statusData &data = *portData[p];
+        
+        data.state = (ports & port.mask);
+        data.autoboot = (autoboot & port.autoboot);
+        if (port.amps >= 0)
+            data.current = sample.value[port.amps];
+        if (port.volts >= 0)
+            data.levels = sample.value[PS_CH_IN_V + port.volts];
+    }
+
+    // the dew heaters are on by their setting, Var shows its setting
+    portData[PSE_DEW1]->setting = sample.value[PS_CH_DEW1_SET];
+    portData[PSE_DEW1]->state = (sample.value[PS_CH_DEW1_SET] > 0);
+    portData[PSE_DEW2]->setting = sample.value[PS_CH_DEW2_SET];
+    portData[PSE_DEW2]->state = (sample.value[PS_CH_DEW2_SET] > 0);
+    portData[PSE_VAR]->levels = sample.value[PS_CH_VAR_SET];
+
+    statusMap["Temp"].levels = sample.value[PS_CH_TEMP];
+    statusMap["Hum"].levels = sample.value[PS_CH_HUM];
+
+    portData[PSE_MP]->setting = sample.value[PS_CH_MP_MODE];
+    statusMap["LED"].setting = sample.value[PS_CH_LED];
+    statusMap["FM"].setting = sample.value[PS_CH_FM];
+}
+
+//******************************************************************
+// Clears the fault bits and their statusMap flags
 void PSCTL::clearFaultStatus()
 {    
-    // Clear statusMap of L1 faults first
-        statusMap["IN"].fault1 = 0;
-        statusMap["FM"].fault1 = 0;
-        statusMap["Bip"].fault1 = 0;
-        statusMap["Int"].fault1 = 0;
-        statusMap["Temp"].fault1 = 0;
-        statusMap["Var"].fault1 = 0;
-        statusMap["Out1"].fault1 = 0;
-        statusMap["Out2"].fault1 = 0;
-        statusMap["Out3"].fault1 = 0;
-        statusMap["Out4"].fault1 = 0;
-        statusMap["Dew1"].fault1 = 0;
-        statusMap["Dew2"].fault1 = 0;
-        statusMap["MP"].fault1 = 0;
-        statusMap["Out1"].fault2 = 0;
-        statusMap["Out2"].fault2 = 0;
-        statusMap["Out3"].fault2 = 0;
-        statusMap["Out4"].fault2 = 0;
-        statusMap["Dew1"].fault2 = 0;
-        statusMap["Dew2"].fault2 = 0;
-        statusMap["Var"].fault2 = 0;
-        statusMap["MP"].fault2 = 0;
-        statusMap["IN"].fault2 = 0;
-        statusMap["INT"].fault2 = 0;
+    applyFaults(0);
 }
-    
+
 //******************************************************************
+// Returns the fault bitset, level 1 in the low 16 bits, level 2 in the high 16
 uint32_t PSCTL::getFaultStatus(uint16_t mask)
 {
-    clearFaultStatus();
+    uint32_t now;
     
-    uint32_t retval = 0;
-    response = hidCMD(PS_FAULT2, 0x00, 0x00, 3);
-    if (response[1] > 0 || response[2] > 0)
-    {
-        statusMap["Out1"].fault2 = (response[1] & 0x01);
-        statusMap["Out2"].fault2 = (response[1] & 0x02);
-        statusMap["Out3"].fault2 = (response[1] & 0x04);
-        statusMap["Out4"].fault2 = (response[1] & 0x08);
-        statusMap["Dew1"].fault2 = (response[1] & 0x10);
-        statusMap["Dew2"].fault2 = (response[1] & 0x20);
-        statusMap["Var"].fault2 = (response[1] & 0x40);
-        statusMap["MP"].fault2 = (response[1] & 0x80);
-       
-        // byte 2
-        statusMap["IN"].fault2 = (response[2] & 0x01);
-        statusMap["IN"].fault2 = (response[2] & 0x02);
-        statusMap["IN"].fault2 = (response[2] & 0x04);
-        statusMap["IN"].fault2 = (response[2] & 0x08);
-        statusMap["INT"].fault2 = (response[2] & 0x10);
-        statusMap["INT"].fault2 = (response[2] & 0x20);
-        statusMap["INT"].fault2 = (response[2] & 0x40);
-        //bit 7 is unused;
+    // readers get the owner's last fault poll (and so the owner's mask)
+    if ( ! (shared && ! shared->isOwner() && shared->live() && shared->faults(&now))) {
+        uint16_t level1 = 0, level2 = 0;
+        cached<PS_FAULT2>(0x00, 0x00, &level2);
+        cached<PS_FAULT1>(mask & 0x00ff, (mask & 0xff00) >> 8, &level1);
+        now = (uint32_t)level2 << 16 | level1;
         
-        retval = (response[2] << 8) + response[1];
+        if (shared)
+            shared->publishFaults(now);
     }
     
-    // get and report level 1 faults
-    response = hidCMD(PS_FAULT1, (mask & 0x00ff), ((mask & 0xff00) >> 8),3);
-    if (response[1] > 0 || response[2] > 0)
-    {
-        // byte1
-        statusMap["IN"].fault1 = (response[1] & 0x02);
-        statusMap["IN"].fault1 = (response[1] & 0x04);
-        statusMap["FM"].fault1 = (response[1] & 0x08);
-        statusMap["Bip"].fault1 = (response[1] & 0x10);
-        statusMap["Int"].fault1 = (response[1] & 0x20);
-        statusMap["Temp"].fault1 = (response[1] & 0x40);
-        statusMap["Var"].fault1 = (response[1] & 0x80);
-        // byte 2
-        statusMap["Out1"].fault1 = (response[2] & 0x01);
-        statusMap["Out2"].fault1 = (response[2] & 0x02);
-        statusMap["Out3"].fault1 = (response[2] & 0x04);
-        statusMap["Out4"].fault1 = (response[2] & 0x08);
-        statusMap["Dew1"].fault1 = (response[2] & 0x10);
-        statusMap["Dew2"].fault1 = (response[2] & 0x20);
-        statusMap["MP"].fault1 = (response[2] & 0x40);
-        statusMap["FM"].fault1 = (response[2] & 0x80);
+    if (metrics)
+        metrics->setFaults(now);
+    
+    if (now != faults)
+        applyFaults(now);
+    
+    return now;
+}
+
+//******************************************************************
+// Queue the transition and touch only the statusMap flags that changed
+void PSCTL::applyFaults(uint32_t now)
+{
+    uint32_t changed = now ^ faults;
+    if (changed == 0)
+        return;
+    
+    psFaultEvent event;
+    event.time = psTimeMs();
+    event.raised = now & changed;
+    event.cleared = faults & changed;
+    event.faults = now;
+    
+    if (faultEvents.size() >= PS_FAULT_EVENTS)
+        faultEvents.pop_front();
+    faultEvents.push_back(event);
+    
+    if (recorder)
+        recorder->trigger(event);
+    
+    // the Power*Star came up again (brownout, button)
+    if ((event.raised & PS_FAULT_POSITION) && ! sharedReader())
+        restorePending = true;
+    
+    // it may have cut a port, or come up with its defaults
+    if (event.raised)
+        dropCached();
+    
+    uint8_t bits[32];
+    int n = psDecodeFaults(changed, bits);
+    for (int i = 0; i < n; i++) {
+        const psFault &fault = psFaults[bits[i]];
         
-        retval = (retval << 16) + (response[2] << 8) + response[1];
+        // a port flag stays set while any of its bits at that level is
+        uint32_t level = (fault.severity == PS_FAULT_FATAL) ? PS_FAULT_LEVEL2 : PS_FAULT_LEVEL1;
+        bool set = (now & level & psPortFaults(fault.port)) != 0;
+        if (fault.severity == PS_FAULT_FATAL)
+            statusMap[fault.port].fault2 = set;
+        else
+            statusMap[fault.port].fault1 = set;
     }
     
-    return retval;
+    faults = now;
+}
+
+//******************************************************************
+// Oldest transition not yet taken
+bool PSCTL::nextFaultEvent(psFaultEvent &event)
+{
+    if (faultEvents.empty())
+        return false;
+    
+    event = faultEvents.front();
+    faultEvents.pop_front();
+    return true;
 }
 
+//***************************************************************
+// Every user limit (PS_GET_ULIMIT 0-11), the ones still fresh from
+// the read cache
+static constexpr psBatchRead ulimitReads[PS_USER_LIMITS] = {
+        psBatch(PSCTL::PS_GET_ULIMIT, 0), psBatch(PSCTL::PS_GET_ULIMIT, 1),
+        psBatch(PSCTL::PS_GET_ULIMIT, 2), psBatch(PSCTL::PS_GET_ULIMIT, 3),
+        psBatch(PSCTL::PS_GET_ULIMIT, 4), psBatch(PSCTL::PS_GET_ULIMIT, 5),
+        psBatch(PSCTL::PS_GET_ULIMIT, 6), psBatch(PSCTL::PS_GET_ULIMIT, 7),
+        psBatch(PSCTL::PS_GET_ULIMIT, 8), psBatch(PSCTL::PS_GET_ULIMIT, 9),
+        psBatch(PSCTL::PS_GET_ULIMIT, 10), psBatch(PSCTL::PS_GET_ULIMIT, 11)
+        };
+
 //***************************************************************
 void PSCTL::getUserLimitStatus(float usrlimit[12]) 
 {
-    usrlimit[0] = getUlimit(0) * .014595;
-    usrlimit[1] = getUlimit(1) * .014595;
-    usrlimit[2] = getUlimit(2) * .0128128;
-    usrlimit[3] = getUlimit(3) * .0128128;
-    usrlimit[4] = getUlimit(4) / 11.23876;
-    usrlimit[5] = getUlimit(5) / 13.21179;
-    usrlimit[6] = getUlimit(6) / 13.21179;
-    usrlimit[7] = getUlimit(7) / 98.9;
-    usrlimit[8] = getUlimit(8) / 98.9;
-    usrlimit[9] = getUlimit(9) / 98.9;
-    usrlimit[10] = getUlimit(10) / 98.9;
-    usrlimit[11] = getUlimit(11) / 98.9;
+    uint16_t counts[PS_USER_LIMITS] {};
+    runBatch(ulimitReads, counts, true);
+    
+    for (const psPort &port : psPorts) {
+        if (port.ampLimit >= 0)
+            usrlimit[port.ampLimit] = counts[port.ampLimit] * port.ampLimitScale;
+        if (port.voltLimit >= 0) {
+            usrlimit[port.voltLimit] = counts[port.voltLimit] * port.voltLimitScale;
+            usrlimit[port.voltLimit + 1] = counts[port.voltLimit + 1] * port.voltLimitScale;
+        }
+    }
 }
 
 //***************************************************************
+// Writes only the limits that don't already read back as asked; a limit
+// is written as counts / step and reads back as counts
 void PSCTL::setUserLimitStatus(float usrlimit[12]) 
 {
-    setUlimit(0, (uint8_t)(usrlimit[0] / .014595 / 4));
-    setUlimit(1, (uint8_t)(usrlimit[1] / .014595 / 4));
-    setUlimit(2, (uint8_t)(usrlimit[2] / .0128128 / 4));
-    setUlimit(3, (uint8_t)(usrlimit[3] / .0128128 / 4));
-    setUlimit(4, (uint8_t)(usrlimit[4] * 11.23876));
-    setUlimit(5, (uint8_t)(usrlimit[5] * 13.21179));
-    setUlimit(6, (uint8_t)(usrlimit[6] * 13.21179));
-    setUlimit(7, (uint8_t)(usrlimit[7] * 98.9 / 4));
-    setUlimit(8, (uint8_t)(usrlimit[8] * 98.9 / 4));
-    setUlimit(9, (uint8_t)(usrlimit[9] * 98.9 / 4));
-    setUlimit(10, (uint8_t)(usrlimit[10] * 98.9 / 4));
-    setUlimit(11, (uint8_t)(usrlimit[11] * 98.9 / 4));
+    uint8_t want[PS_USER_LIMITS] {};
+    uint8_t step[PS_USER_LIMITS] {};
+    for (const psPort &port : psPorts) {
+        if (port.ampLimit >= 0) {
+            want[port.ampLimit] = usrlimit[port.ampLimit] / port.ampLimitScale / port.ampLimitStep;
+            step[port.ampLimit] = port.ampLimitStep;
+        }
+        if (port.voltLimit >= 0) {
+            want[port.voltLimit] = usrlimit[port.voltLimit] / port.voltLimitScale / PS_VOLT_LIMIT_STEP;
+            want[port.voltLimit + 1] = usrlimit[port.voltLimit + 1] / port.voltLimitScale / PS_VOLT_LIMIT_STEP;
+            step[port.voltLimit] = step[port.voltLimit + 1] = PS_VOLT_LIMIT_STEP;
+        }
+    }
+    
+    bool session = hidBegin();
+    uint16_t counts[PS_USER_LIMITS] {};
+    uint32_t got = runBatch(ulimitReads, counts, true);
+    
+    for (uint8_t limit = 0; limit < PS_USER_LIMITS; limit++)
+        if (step[limit] && ! ((got >> limit & 1) && (counts[limit] + step[limit] / 2) / step[limit] == want[limit]))
+            setUlimit(limit, want[limit]);
+    
+    if (session)
+        hidEnd();
 }
 
 //***************************************************************
-PowerStarProfile PSCTL::getProfileStatus() 
+// The registers a profile sets (PS_PROFILE_FIELD order, less the lock),
+// their reads and writes
+static constexpr psBatchRead profileReads[PS_PROFILE_LOCK] = {
+        psBatch(PSCTL::PS_GET_MTR_LED), psBatch(PSCTL::PS_GET_MTRPOL),
+        psBatch(PSCTL::PS_GET_BACKLASH), psBatch(PSCTL::PS_GET_TCOMP),
+        psBatch(PSCTL::PS_GET_TMPCO), psBatch(PSCTL::PS_GET_HYS),
+        psBatch(PSCTL::PS_GET_SPERIOD), psBatch(PSCTL::PS_GET_MTRCUR)
+        };
+
+static constexpr psBatchRead profileWrites[PS_PROFILE_LOCK] = {
+        psBatch(PSCTL::PS_SET_MTR_LED), psBatch(PSCTL::PS_SET_MTRPOL),
+        psBatch(PSCTL::PS_SET_BACKLASH), psBatch(PSCTL::PS_SET_TCOMP),
+        psBatch(PSCTL::PS_SET_TMPCO), psBatch(PSCTL::PS_SET_HYS),
+        psBatch(PSCTL::PS_SET_SPERIOD), psBatch(PSCTL::PS_SET_MTRCUR)
+        };
+
+const char *psProfileFields[PS_PROFILE_NFIELDS] = {
+        "motor type", "reverse", "backlash", "temp comp", "temp coef",
+        "hysteresis", "step period", "motor current", "unlock"
+        };
+
+static const char *applyNames[] = { "same", "written", "failed", "restored", "skipped" };
+
+//***************************************************************
+// The profile registers in fields (1 << PS_PROFILE_FIELD) and the
+// PS_READ_ positions, in one USB session and the fresh ones from the
+// read cache; the rest of the profile is left 0
+PowerStarProfile PSCTL::getProfileStatus(uint32_t fields) 
 {
-    PowerStarProfile actProfile;
+    PowerStarProfile actProfile {};
     strncpy(actProfile.name, "Actual", sizeof(actProfile.name));
     
-    response = hidCMD(PS_GET_BACKLASH, 0, 0, 3);
-    actProfile.backlash = response[1]; 
-    actProfile.prefDir = response[2];
-    
-    response = hidCMD(PS_GET_MTRCUR, 0, 0, 3);
-    actProfile.idleMtrCurrent = response[1];
-    actProfile.driveMtrCurrent = response[2];
+    uint16_t regs[PS_PROFILE_LOCK] {};
+    bool session = hidBegin();
+    runBatch(profileReads, regs, true, fields);
+    if (fields & PS_READ_POSITION)
+        getPosition(&actProfile.curPosition, PS_GET_POS);
+    if (fields & PS_READ_MAX)
+        getPosition(&actProfile.maxPosition, PS_GET_MAX);
+    if (session)
+        hidEnd();
     
-    response = hidCMD(PS_GET_SPERIOD, 0, 0, 2);
-    actProfile.stepPeriod = response[1] / 10;
+    actProfile.motorType = regs[PS_PROFILE_MTR_TYPE] >> 8;
+    actProfile.reverseMtr = regs[PS_PROFILE_REVERSE];
+    actProfile.backlash = regs[PS_PROFILE_BACKLASH] & 0xff; 
+    actProfile.prefDir = regs[PS_PROFILE_BACKLASH] >> 8;
+    actProfile.tempSensor = regs[PS_PROFILE_TCOMP];
+    actProfile.tempCoef = regs[PS_PROFILE_TMPCO] / 256.0;
+    actProfile.tempHysterisis = regs[PS_PROFILE_HYS] / 10;
+    actProfile.stepPeriod = regs[PS_PROFILE_SPERIOD] / 10;
+    actProfile.idleMtrCurrent = regs[PS_PROFILE_MTRCUR] & 0xff;
+    actProfile.driveMtrCurrent = regs[PS_PROFILE_MTRCUR] >> 8;
     
-    getPosition(&actProfile.curPosition, PS_GET_POS);
-    getPosition(&actProfile.maxPosition, PS_GET_MAX);
+    // not readable: motorBraking 0:None, disablePermFocus, faultMask
+    return actProfile;
+}
 
-    response = hidCMD(PS_GET_TMPCO, 0, 0, 3);
-    float lbyte = response[1];
-    actProfile.tempCoef = response[2] + (lbyte / 256);
-    
-    response = hidCMD(PS_GET_HYS, 0, 0, 2);
-    actProfile.tempHysterisis = response[1] / 10;
-    
-    response = hidCMD(PS_GET_TCOMP, 0, 0, 2);
-    actProfile.tempSensor = response[1];
-    
-    response = hidCMD(PS_GET_MTRPOL, 0, 0, 2);
-    actProfile.reverseMtr = response[1];
+//******************************************************************
+// Set Devices
+//******************************************************************
+
+//******************************************************************
+// Mask of a list of port names ("out1,usb2 var" or "all"), their
+// PS_PORT_CTL bits or with autoboot their PS_SET_AUTO bits
+bool PSCTL::portMask(const string &devices, bool autoboot, uint16_t *mask)
+{
+    *mask = 0;
+    size_t at = 0;
+    while ((at = devices.find_first_not_of(", ", at)) != string::npos) {
+        size_t end = devices.find_first_of(", ", at);
+        string name = devices.substr(at, end - at);
+        at = end;
+        
+        int p = psPortIndex(name.c_str());
+        uint16_t bit = strcasecmp(name.c_str(), "all") == 0 ? PS_PORTS_ALL : p < 0 ? 0 : autoboot ? psPorts[p].autoboot : psPorts[p].mask;
+        if (bit == 0)
+            return false;
+        *mask |= bit;
+    }
+    return *mask != 0;
+}
+
+//******************************************************************
+// Turns ports/usb on or off
+bool PSCTL::setPowerState(const string &device, const string &action, uint16_t *refused)
+{
+    uint16_t mask;
+    if ( ! portMask(device, false, &mask))
+        return false;
     
-    actProfile.disablePermFocus = 0;
+    if (action == "yes")
+        return setPowerStates(mask, 0, refused);
+    if (action == "no")
+        return setPowerStates(0, mask, refused);
+    return false;
+}
+
+//******************************************************************
+// Turns the on ports on and the off ports off, the rest as they are,
+// all in one PS_PORT_CTL (none if nothing changes)
+bool PSCTL::setPowerStates(uint16_t on, uint16_t off, uint16_t *refused)
+{
+    uint16_t portStatus;
     
-    response = hidCMD(PS_GET_MTRPOL, 0, 0, 3);
-    actProfile.motorBraking = 0;    // 0:None 1:Low 2:Normal
+    if (refused)
+        *refused = 0;
     
-    response = hidCMD(PS_GET_MTR_LED, 0, 0, 3);
-    actProfile.motorType = response[2];
+    if ((on & off) || ! getPortStatus(&portStatus))
+        return false;
     
-    response = hidCMD(PS_GET_MTRLCK, 0, 0, 3);
-    actProfile.faultMask = 0;
-    strncpy(actProfile.out1, "", sizeof(actProfile.out1));
-    strncpy(actProfile.out2, "", sizeof(actProfile.out2));
-    strncpy(actProfile.out3, "", sizeof(actProfile.out3));
-    strncpy(actProfile.out4, "", sizeof(actProfile.out4));
-    strncpy(actProfile.dew1, "", sizeof(actProfile.dew1));
-    strncpy(actProfile.dew2, "", sizeof(actProfile.dew2));
-    strncpy(actProfile.var, "", sizeof(actProfile.var));
-    strncpy(actProfile.mp, "", sizeof(actProfile.mp));
-    strncpy(actProfile.usb1, "", sizeof(actProfile.usb1));
-    strncpy(actProfile.usb2, "", sizeof(actProfile.usb2));
-    strncpy(actProfile.usb3, "", sizeof(actProfile.usb3));
-    strncpy(actProfile.usb4, "", sizeof(actProfile.usb4));
-    strncpy(actProfile.usb5, "", sizeof(actProfile.usb5));
-    strncpy(actProfile.usb6, "", sizeof(actProfile.usb6));
+    for (uint8_t port = 0; budget && port < PSE_IN; port++)
+        if (psPorts[port].mask & off)
+            budget->cancel(port);
     
+    uint16_t want = (portStatus & ~off) | on;
+    if (want == portStatus)
+        return true;
     
-    return actProfile;
+    return setPortStatus(want, refused);
 }
 
 //******************************************************************
-// Set Devices
-//******************************************************************
-
-//******************************************************************
-// Turns ports/usb on or off
-bool PSCTL::setPowerState(const string &device, const string &action)
+// Writes the whole port/usb on mask
+bool PSCTL::setPortStatus(uint16_t portStatus, uint16_t *refused)
 {
     uint8_t portCtl;
     uint8_t usbCtl;
     
-    response = hidCMD(PS_PORT_STATUS, 0x00, 0x00, 3);
-    uint16_t portStatus = response[2] * 256 + response[1];
+    BITMASK_CLEAR(portStatus, 0xc030);
     
-    if (devmask.find(device) == devmask.end())
-        return false;
+    // ports coming on must fit the budget, the rest go ahead
+    uint16_t turnedDown = 0;
+    uint16_t was = budget ? budget->portMask() : 0;
+    for (uint8_t port = 0; budget && port < PSE_IN; port++) {
+        uint16_t bit = psPorts[port].mask;
+        if (bit && (portStatus & bit) && ! (was & bit) && ! admit(port, PSB_PORT, 0)) {
+            BITMASK_CLEAR(portStatus, bit);
+            turnedDown |= bit;
+        }
+    }
+    if (refused)
+        *refused = turnedDown;
+    
+    portCtl = portStatus & 0xFF;
+    usbCtl = (portStatus & 0xFF00) >> 8;
         
-    if (action == "yes")
-        BITMASK_SET(portStatus, devmask[device]);
+    if ( ! command<PS_PORT_CTL>(portCtl, usbCtl))
+        return false;
 
-    else if (action == "no") 
-        BITMASK_CLEAR(portStatus, devmask[device]);
+    if (budget) {
+        for (uint8_t port = 0; port < PSE_IN; port++)
+            if ((was & psPorts[port].mask) && ! (portStatus & psPorts[port].mask))
+                budget->book(port, 0);
+        budget->bookPorts(portStatus);
+    }
+    if (journal)
+        journal->setPorts(portStatus);
+    return true;
+}
 
-    else
+//******************************************************************
+// Safety cut, turns the off ports off and leaves the rest of the mask
+// (from the shadow) as it is, no budget admission as nothing comes on
+bool PSCTL::cutPorts(uint16_t off)
+{
+    uint16_t portStatus;
+    if ( ! getPortStatus(&portStatus))
         return false;
-        
+    
+    portStatus &= ~off;
     BITMASK_CLEAR(portStatus, 0xc030);
-    portCtl = portStatus & 0xFF;
-    usbCtl = (portStatus & 0xFF00) >> 8;
-        
-    response = hidCMD(PS_PORT_CTL, portCtl, usbCtl, 3);
-        
-    if (response[1] == 0xff || response[2] == 0xff)
+    if ( ! command<PS_PORT_CTL>(portStatus & 0xFF, portStatus >> 8))
         return false;
+    
+    if (budget) {
+        for (uint8_t port = 0; port < PSE_IN; port++)
+            if (psPorts[port].mask & off) {
+                budget->cancel(port);
+                budget->book(port, 0);
+            }
+        budget->bookPorts(portStatus);
+    }
+    if (journal)
+        journal->setPorts(portStatus);
+    return true;
+}
 
+//******************************************************************
+bool PSCTL::getPortStatus(uint16_t *portStatus)
+{
+    uint8_t lo, hi;
+    if ( ! getRegister(PS_REG_PORTS, &lo, &hi))
+        return false;
+    
+    *portStatus = hi * 256 + lo;
+    return true;
+}
+
+//******************************************************************
+// One PS_CURRENT channel (PSE_PORT) in amps, dew scaled by its setting
+bool PSCTL::getCurrent(uint8_t port, float *amps)
+{
+    uint16_t counts;
+    if (port >= PSE_NPORTS || ! command<PS_CURRENT>(port, 0x00, &counts))
+        return false;
+    
+    *amps = portAmps(port, counts, sample);
+    return true;
+}
+
+//******************************************************************
+// One PS_VOLTS channel (0:IN 1:Var 2:Int) in volts
+bool PSCTL::getVolts(uint8_t channel, float *volts)
+{
+    uint16_t counts;
+    if (channel >= 3 || ! command<PS_VOLTS>(channel, 0x00, &counts))
+        return false;
+    
+    *volts = counts * voltScale[channel];
     return true;
-        
 }
 
 //**************************************************************
 bool PSCTL::setDew(uint8_t channel, uint8_t percent)
 {
-    response = hidCMD(PS_DEW_CTL, channel, percent, 3);
-    if (response[2] == 0xff) {
+    // channel 2 is MP in dew mode
+    if (budget && ! admit(channel < 2 ? PSE_DEW1 + channel : PSE_MP, PSB_DEW, percent))
         return false;
-    }
+    
+    if ( ! command<PS_DEW_CTL>(channel, percent))
+        return false;
+    
+    // getCurrent scales the dew current by this
+    if (channel < 2)
+        sample.value[PS_CH_DEW1_SET + channel] = percent;
+    if (journal)
+        journal->setDew(channel, percent);
     return true;
 }
 
 //**************************************************************
 bool PSCTL::setUlimit(uint8_t device, uint8_t adcLimit)
 {
-    response = hidCMD(PS_SET_ULIMIT, device, adcLimit, 3);
+    command<PS_SET_ULIMIT>(device, adcLimit);
 
     return true;
 }
@@ -431,41 +1341,42 @@ bool PSCTL::setUlimit(uint8_t device, uint8_t adcLimit)
 //**************************************************************
 uint16_t PSCTL::getUlimit(uint8_t device)
 {
-    response = hidCMD(PS_GET_ULIMIT, device, 0x00, 3);
-    return response[2] * 256 + response[1];
+    uint16_t limit = 0;
+    cached<PS_GET_ULIMIT>(device, 0x00, &limit);
+    return limit;
 }
 
 //**************************************************************
 bool PSCTL::setPWM(uint16_t pwmamt)
 {
-    uint8_t pwmlow = pwmamt & 0x00ff;
-    uint8_t pwmhigh = (pwmamt & 0xff00) / 256;
-
-    response = hidCMD(PS_SET_PWM, pwmlow, pwmhigh, 3);
-    if (response[2] == 0xff) {
+    if (budget && ! admit(PSE_MP, PSB_PWM, pwmamt))
         return false;
-    }
-    return true;
+    
+    return command<PS_SET_PWM>(pwmamt & 0x00ff, (pwmamt & 0xff00) >> 8);
 }
 
 //******************************************************************
 // set the voltage for the variable output port
 bool PSCTL::setVar(uint8_t voltage)
 {
-    response = hidCMD(PS_SET_VAR, voltage, 0x00, 2);
-    if (response[1] == 0xff) {
+    if (budget && ! admit(PSE_VAR, PSB_VAR, voltage))
+        return false;
+    
+    if ( ! command<PS_SET_VAR>(voltage))
         return false;
-    }
-    else
-        return true;
+    
+    if (journal)
+        journal->setVar(voltage);
+    return true;
 }
 
 //******************************************************************
 // get the pwm duty cycle for MP
 uint16_t PSCTL::getPWM()
 {
-    response = hidCMD(PS_GET_PWM, 0x00, 0x00, 2);
-    return response[2] * 256 + response[1];
+    uint16_t pwm = 0;
+    cached<PS_GET_PWM>(0x00, 0x00, &pwm);
+    return pwm;
 }
 
 //******************************************************************
@@ -473,67 +1384,59 @@ uint16_t PSCTL::getPWM()
 uint8_t PSCTL::getDew(uint8_t device)
 {
     // 0 = dew1, 1 = dew2, 2 = MP if set to dew
-    response = hidCMD(PS_DEW_STATUS, device, 0x00, 2);
-    return response[2];
+    uint16_t percent = 0;
+    cached<PS_DEW_STATUS>(device, 0x00, &percent);
+    return percent;
 }
 
 //******************************************************************
 // sets autoboot options
 bool PSCTL::setAutoBoot(string &device, string &action)
+{
+    uint16_t mask;
+    if ( ! portMask(device, true, &mask))
+        return false;
+    
+    if (action == "on")
+        return setAutoBoots(mask, 0);
+    if (action == "off")
+        return setAutoBoots(0, mask);
+    return false;
+}
+
+//******************************************************************
+// setPowerStates for the autoboot mask, one PS_SET_AUTO
+bool PSCTL::setAutoBoots(uint16_t on, uint16_t off)
 {
     uint8_t portCtl;
     uint8_t usbCtl;
     
-    response = hidCMD(PS_GET_AUTO, 0x00, 0x00, 3);
-    if (response[2] == 0xff) {
-        return false;
-    }
-    uint16_t portStatus = response[2] * 256 + response[1];
-
-    if (devmask.find(device) != devmask.end()) {
-        
-        if (action == "on") {
-            BITMASK_SET(portStatus, devmask[device]);
-            portCtl = portStatus & 0xFF;
-            usbCtl = (portStatus & 0xFF00) >> 8;
-        }
-        else if (action == "off") {
-            BITMASK_CLEAR(portStatus, devmask[device]);
-            portCtl = portStatus & 0xFF;
-            usbCtl = (portStatus & 0xFF00) >> 8;
-        }
-        
-        else {
-            return false;
-        }
-        
-        response = hidCMD(PS_SET_AUTO, portCtl, usbCtl, 3);
-        if (response[2] == 0xff) {
-            return false;
-        }
-        else {
-            return true;
-        }
-    }
-    else {
+    if ((on & off) || ! getRegister(PS_REG_AUTO, &portCtl, &usbCtl))
         return false;
-    }
     
-    return true;
+    uint16_t autoBoot = usbCtl * 256 + portCtl;
+    uint16_t want = (autoBoot & ~off) | on;
+    if (want == autoBoot)
+        return true;
+    
+    return command<PS_SET_AUTO>(want & 0xFF, (want & 0xFF00) >> 8);
 }
 
 //******************************************************
 //MPtype: 0=DC, 1=PWM, 2=Dew
 bool PSCTL::setMultiPort(uint8_t MPtype)
 {
-    response = hidCMD(PS_GET_MTR_LED, 0x00, 0x00, 3);  //get current settings
+    uint8_t mtrLed, mtrType;
+    if ( ! getRegister(PS_REG_MTR_LED, &mtrLed, &mtrType))  //get current settings
+        return false;
     
-    uint8_t bcmd = ((MPtype & 0x0f) | (response[1] & 0xf0));
+    uint8_t bcmd = ((MPtype & 0x0f) | (mtrLed & 0xf0));
     
-    response = hidCMD(PS_SET_MTR_LED, bcmd, response[2], 3);
-    if (response[1] == 0xff) {
+    if ( ! command<PS_SET_MTR_LED>(bcmd, mtrType))
         return false;
-    }
+    
+    if (journal)
+        journal->setMultiPort(MPtype);
     return true;
 }
     
@@ -542,81 +1445,139 @@ bool PSCTL::setMultiPort(uint8_t MPtype)
 bool PSCTL::setLED(uint8_t brightness)
 {
     //get current settings
-    response = hidCMD(PS_GET_MTR_LED, 0x00, 0x00, 3);  
+    uint8_t mtrLed, mtrType;
+    if ( ! getRegister(PS_REG_MTR_LED, &mtrLed, &mtrType))
+        return false;
     
-    uint8_t bcmd = ((brightness << 4) | (response[1] & 0x0f));
+    uint8_t bcmd = ((brightness << 4) | (mtrLed & 0x0f));
     
-    response = hidCMD(PS_SET_MTR_LED, bcmd, response[2], 3);
-    if (response[1] == 0xff) {
+    if ( ! command<PS_SET_MTR_LED>(bcmd, mtrType))
         return false;
-    }
+    
+    if (journal)
+        journal->setLED(brightness);
     return true;
 }
 
 //***************************************************************
+// A register write of value, args low byte then high byte
+bool PSCTL::command(const psBatchRead &write)
+{
+    const psCommand &cmd = *write.cmd;
+    response = hidCMD((PS_COMMANDS)cmd.opcode, write.arg1, write.arg2, cmd.request);
+    return commandOk(cmd, response, nullptr);
+}
+
+//***************************************************************
+// Applies psProfile as one transaction: reads every register, writes
+// the ones that differ, reads them all back, and puts back what it
+// wrote if a write or the read back fails.  Commits to NVM once, and
+// only if this or a setting since the last commit changed something.
+// profileApplied has how each field went.
 bool PSCTL::activateProfile(PowerStarProfile psProfile)
 {    
-    // Set Motor Type
-    // need to read in status first, then set mtr type and put back
-    //keep response[1] as that sets Mp and LED modes
-    response = hidCMD(PS_GET_MTR_LED, 0x00, 0x00, 3);
-    response = hidCMD(PS_SET_MTR_LED, response[1], psProfile.motorType, 3);
-    if (response[1] == 0xff)
-        return false;
-    
-    // Set reverse motor
-    response = hidCMD(PS_SET_MTRPOL, psProfile.reverseMtr, 0x00, 2);
-    if (response[1] == 0xff)
-        return false;
+    for (PS_APPLY &applied : profileApplied)
+        applied = PS_APPLY_SKIPPED;
     
-    // Backlash amount and preferred direction
-    hidCMD(PS_SET_BACKLASH, psProfile.backlash, psProfile.prefDir, 3);
+    bool session = hidBegin();
+    bool dirty = nvmDirty;
     
-    // Unlocking the Motor
-    response = hidCMD(PS_SET_MTRLCK, 0x5a, psProfile.motorBraking, 3);
-    if (response[1] == 0xff)
-        return false;
-    
-    // Set temperature compensation 0=disabled, 1=motor, 2=env
-    response = hidCMD(PS_SET_TCOMP, psProfile.tempSensor, 0x00, 2);
-    if (response[1] == 0xff)
-        return false;
+    // snapshot, then what each register is written with
+    uint16_t before[PS_PROFILE_LOCK], after[PS_PROFILE_LOCK], want[PS_PROFILE_LOCK];
+    uint32_t got = runBatch(profileReads, before);
     
-    // Temp compensation temperature coefficient
     uint8_t hbyte = (psProfile.tempCoef);
     uint8_t lbyte = (psProfile.tempCoef - hbyte) * 256;
-    hidCMD(PS_SET_TMPCO, lbyte, hbyte, 3);
     
-    // Temp compensation hysteresis
-    response = hidCMD(PS_SET_HYS, (uint8_t)(psProfile.tempHysterisis * 10), 0x00, 2);
-    if (response[1] == 0xff)
-        return false;
-
-    // Step Period
-    response = hidCMD(PS_SET_SPERIOD, (uint8_t)(psProfile.stepPeriod * 10), 0x00, 2);
-    if (response[1] == 0xff)
-        return false;
-        
-    // Motor idle and drive current
-    response = hidCMD(PS_SET_MTRCUR, psProfile.idleMtrCurrent, psProfile.idleMtrCurrent, 3);
-    if (response[1] == 0xff || response[2] == 0xff)
+    // keep the low byte as that sets Mp and LED modes
+    want[PS_PROFILE_MTR_TYPE] = (before[PS_PROFILE_MTR_TYPE] & 0xff) | psProfile.motorType << 8;
+    want[PS_PROFILE_REVERSE] = psProfile.reverseMtr;
+    want[PS_PROFILE_BACKLASH] = (uint8_t)psProfile.backlash | psProfile.prefDir << 8;
+    want[PS_PROFILE_TCOMP] = psProfile.tempSensor;          // 0=disabled, 1=motor, 2=env
+    want[PS_PROFILE_TMPCO] = lbyte | hbyte << 8;
+    want[PS_PROFILE_HYS] = (uint8_t)(psProfile.tempHysterisis * 10);
+    want[PS_PROFILE_SPERIOD] = (uint8_t)(psProfile.stepPeriod * 10);
+    want[PS_PROFILE_MTRCUR] = psProfile.idleMtrCurrent | psProfile.driveMtrCurrent << 8;
+    
+    // without the LED/MP byte the motor type can't be written
+    bool ok = got & (1u << PS_PROFILE_MTR_TYPE);
+    
+    uint32_t wrote = 0;
+    for (int field = 0; ok && field < PS_PROFILE_LOCK; field++) {
+        if ((got >> field & 1) && before[field] == want[field]) {
+            profileApplied[field] = PS_APPLY_SAME;
+            continue;
+        }
+        wrote |= 1u << field;
+        ok = command({ profileWrites[field].cmd, (uint8_t)(want[field] & 0xff), (uint8_t)(want[field] >> 8) });
+        profileApplied[field] = ok ? PS_APPLY_WRITTEN : PS_APPLY_FAILED;
+    }
+    
+    // Unlocking the Motor, not readable: unless it was unlocked with this braking
+    if (ok) {
+        profileApplied[PS_PROFILE_LOCK] = PS_APPLY_SAME;
+        if (brakingSent != psProfile.motorBraking) {
+            ok = command<PS_SET_MTRLCK>(0x5a, psProfile.motorBraking);
+            profileApplied[PS_PROFILE_LOCK] = ok ? PS_APPLY_WRITTEN : PS_APPLY_FAILED;
+        }
+    }
+    
+    // did they take
+    if (ok && wrote) {
+        uint32_t back = runBatch(profileReads, after);
+        for (int field = 0; field < PS_PROFILE_LOCK; field++)
+            if ((wrote >> field & 1) && ! ((back >> field & 1) && after[field] == want[field])) {
+                profileApplied[field] = PS_APPLY_FAILED;
+                ok = false;
+            }
+    }
+    
+    // put back what was written, last first; the one that failed stays failed
+    if ( ! ok) {
+        for (int field = PS_PROFILE_LOCK - 1; field >= 0; field--) {
+            if ( ! (wrote >> field & 1) || ! (got >> field & 1))
+                continue;
+            bool undone = command({ profileWrites[field].cmd, (uint8_t)(before[field] & 0xff), (uint8_t)(before[field] >> 8) });
+            if (profileApplied[field] == PS_APPLY_WRITTEN)
+                profileApplied[field] = undone ? PS_APPLY_RESTORED : PS_APPLY_FAILED;
+        }
+        nvmDirty = dirty;
+    }
+    
+    if (session)
+        hidEnd();
+    
+    if ( ! ok)
         return false;
     
-    if ( ! saveDewPwmFault(psProfile))
+    // one commit, and only for a change
+    if (nvmDirty && ! saveDewPwmFault(psProfile))
         return false;
     
     return true;
 }
+
+//***************************************************************
+// The fields the last activateProfile didn't leave as they were, e.g.
+// "backlash written, hysteresis failed"
+string PSCTL::profileReport()
+{
+    string report;
+    for (int field = 0; field < PS_PROFILE_NFIELDS; field++) {
+        if (profileApplied[field] == PS_APPLY_SAME)
+            continue;
+        if ( ! report.empty())
+            report += ", ";
+        report += string(psProfileFields[field]) + " " + applyNames[profileApplied[field]];
+    }
+    return report;
+}
     
 //****************************************************************
 bool PSCTL::saveDewPwmFault(PowerStarProfile psProfile)
 {
     // save dew, pwm and fault maps to nvm
-    response = hidCMD(PS_SET_MTRLCK, 0xaa, (uint8_t)(psProfile.motorBraking * 10), 3);
-    if (response[1] == 0xff)
-        return false;
-    
-    return true;
+    return command<PS_SET_MTRLCK>(0xaa, psProfile.motorBraking * 10);
 }
     
 //****************************************************************
@@ -626,16 +1587,18 @@ bool PSCTL::saveDewPwmFault(PowerStarProfile psProfile)
 //****************************************************************
 // Get Version
 uint16_t PSCTL::getVersion(){
-    response = hidCMD(PS_VERSION, 0x00, 0x00, 1);
-    return (response[2] *256) + response[1];
+    uint16_t version = 0;
+    cached<PS_VERSION>(0x00, 0x00, &version);
+    return version;
 }
 
 //******************************************************************
 // Get Temperature
 float PSCTL::getTemperature()
 {
-    uint8_t* response = hidCMD(PS_GET_WEATHER, PS_TEMP, 0x00, 3);
-    float curTemp = ((response[2] * 256 + response[1]) / 256) * 9 / 5.0 + 32; // in F
+    uint16_t temp = 0;
+    cached<PS_GET_WEATHER>(PS_TEMP, 0x00, &temp);
+    float curTemp = (temp / 256) * 9 / 5.0 + 32; // in F
     return curTemp;
 }
 
@@ -643,8 +1606,9 @@ float PSCTL::getTemperature()
 // Get Humidity
 float PSCTL::getHumidity()
 {
-    uint8_t* response = hidCMD(PS_GET_WEATHER, PS_HUM, 0x00, 3);
-    float curhum = response[2] * 256 + response[1];
+    uint16_t hum = 0;
+    cached<PS_GET_WEATHER>(PS_HUM, 0x00, &hum);
+    float curhum = hum;
     return curhum;
 }
 
@@ -652,8 +1616,9 @@ float PSCTL::getHumidity()
 // Clears faults
 bool PSCTL::clearFaults()
 {
-    response = hidCMD(PS_FAULT2, 0x01, 0x00, 2);
-    if (response[1] == 0xff )
+    // the echo of the clear, not a fault word
+    uint16_t echo;
+    if ( ! command<PS_FAULT2>(0x01, 0x00, &echo) || (echo & 0xff) == 0xff)
         return false;
     else
         return true;
@@ -663,7 +1628,10 @@ bool PSCTL::clearFaults()
 // Restarts PS
 bool PSCTL::restart()
 {
-    response = hidCMD(PS_RESET, 0xa5, 0x5a, 3);
+    // not through the watchdog, a rebooting Power*Star doesn't answer
+    restorePending = true;
+    dropCached();
+    response = hidTimed(PS_RESET, 0xa5, 0x5a, 3);
     if (response[1] == 0xff )
         return false;
     else
@@ -671,21 +1639,293 @@ bool PSCTL::restart()
 }
 
 //************************************************
+// Serialize USB access between processes using the Power*Star; the lock
+// keeps the pid of its last holder so each can tell when another was
+// there and what it has cached may be out of date
+static int      usbLockFd = -2;
+static int32_t *usbLockLast = nullptr;     // null: can't tell, assume another
+
+static void usbLockOpen()
+{
+    if (usbLockFd != -2)
+        return;
+    
+    usbLockFd = shm_open(PS_USB_LOCK_NAME, O_RDWR | O_CREAT, 0600);
+    if (usbLockFd < 0) {
+        // flock works on a read only descriptor too, but without writing
+        // our pid every holder looks like another (PS_SHM_GROUP fixes it)
+        usbLockFd = shm_open(PS_USB_LOCK_NAME, O_RDONLY, 0);
+        return;
+    }
+    
+    PSSHARED::protect(usbLockFd);
+    if (ftruncate(usbLockFd, sizeof(int32_t)) < 0)
+        return;
+    void *map = mmap(nullptr, sizeof(int32_t), PROT_READ | PROT_WRITE, MAP_SHARED, usbLockFd, 0);
+    if (map != MAP_FAILED)
+        usbLockLast = (int32_t *)map;
+}
+
+//************************************************
+// Someone else held the USB lock last
+static bool usbElsewhere()
+{
+    usbLockOpen();
+    return usbLockLast == nullptr || __atomic_load_n(usbLockLast, __ATOMIC_ACQUIRE) != getpid();
+}
+
+//************************************************
+// True when taking it finds another process was there last
+static bool usbLock(bool lock)
+{
+    usbLockOpen();
+    if (usbLockFd < 0)
+        return lock;
+    
+    if ( ! lock) {
+        flock(usbLockFd, LOCK_UN);
+        return false;
+    }
+    
+    flock(usbLockFd, LOCK_EX);
+    bool other = usbElsewhere();
+    if (usbLockLast)
+        __atomic_store_n(usbLockLast, (int32_t)getpid(), __ATOMIC_RELEASE);
+    return other;
+}
+
+//************************************************
+// Reads, the only commands sent again after a recovery step; an
+// unanswered write may or may not have been carried out
+static bool resendable(uint8_t hcmd, uint8_t hidArg1)
+{
+    switch (hcmd) {
+        case PSCTL::PS_GET_STATUS:
+        case PSCTL::PS_GET_POS:
+        case PSCTL::PS_GET_HBITS:
+            return true;
+            
+        case PSCTL::PS_FAULT2:
+            return hidArg1 == 0;        // with an argument it clears them
+            
+        default:
+            return cacheTtl(hcmd) > 0;
+    }
+}
+
+//************************************************
+// Watchdog around every command: a run of failed commands takes one
+// recovery step (see PS_USB_STATE), a run of slow replies a port reset
 uint8_t* PSCTL::hidCMD(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd)
+{
+    static uint8_t lost[3] = {0xff, 0xff, 0xff};
+    
+    // gave up, fail fast until the next attempt is due
+    if (usb == PS_USB_LOST && psTimeMs() < usbRetryAt)
+        return lost;
+    
+    uint8_t *res = hidTimed(hcmd, hidArg1, hidArg2, numCmd);
+    
+    if (res[0] == 0xff) {
+        if (usb == PS_USB_LOST) {
+            usbRecover(PS_USB_REOPEN);
+            usbRetryAt = psTimeMs() + PS_USB_RETRY_MS;
+            return res;
+        }
+        if (++usbFails < PS_USB_FAIL_MAX)
+            return res;
+        
+        usbFails = 0;
+        if (usbEscalate() == PS_USB_LOST || ! resendable(hcmd, hidArg1))
+            return res;
+        res = hidTimed(hcmd, hidArg1, hidArg2, numCmd);
+        if (res[0] == 0xff)
+            return res;
+    }
+    
+    // answers, but late: a port reset usually clears a stalling hub
+    if (usbSlow >= PS_USB_SLOW_MAX) {
+        usbChange(PS_USB_RESET);
+        usbRecover(PS_USB_RESET);
+        usbSlow = 0;
+    }
+    usbFails = 0;
+    if (usb != PS_USB_OK)
+        usbChange(PS_USB_OK);
+    shadowCommand(hcmd, hidArg1, hidArg2, res);
+    cacheCommand(hcmd, hidArg1, hidArg2, res);
+    nvmCommand(hcmd, hidArg1, hidArg2);
+    return res;
+}
+
+//************************************************
+// The next recovery step, taken; PS_RESET is skipped unless allowed
+PS_USB_STATE PSCTL::usbEscalate()
+{
+    PS_USB_STATE step = usb == PS_USB_OK ? PS_USB_REOPEN
+                      : usb == PS_USB_REOPEN ? PS_USB_RESET
+                      : usb == PS_USB_RESET && usbReboot ? PS_USB_REBOOT
+                      : PS_USB_LOST;
+    
+    usbChange(step);
+    if (step == PS_USB_LOST)
+        usbRetryAt = psTimeMs() + PS_USB_RETRY_MS;
+    else
+        usbRecover(step);
+    return step;
+}
+
+//************************************************
+// Timed for the watchdog deadline and the exporter
+uint8_t* PSCTL::hidTimed(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint8_t *res = hidIO(hcmd, hidArg1, hidArg2, numCmd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (res[0] != 0xff && secs * 1000 > PS_USB_DEADLINE_MS)
+        usbSlow++;
+    else
+        usbSlow = 0;
+    
+    if (metrics)
+        metrics->command(hcmd, secs, res[0] != 0xff);
+    return res;
+}
+
+//************************************************
+// One escalation step, leaves a held session holding a fresh handle
+void PSCTL::usbRecover(PS_USB_STATE step)
+{
+    if (held) {
+        hid_close(handle);
+        handle = nullptr;
+    }
+    else if (usbLock(true))
+        dropCached();
+    
+    // start over with a new libusb context
+    hid_exit();
+    
+    hid_device *dev;
+    if (step == PS_USB_RESET && (dev = hid_open(0x4D8, 0xEC42, nullptr)) != nullptr) {
+        hid_reset(dev);
+        hid_close(dev);
+        hid_exit();
+        usleep(PS_USB_SETTLE_MS * 1000);
+    }
+    else if (step == PS_USB_REBOOT && (dev = hid_open(0x4D8, 0xEC42, nullptr)) != nullptr) {
+        uint8_t cmd[3] = {PS_RESET, 0xa5, 0x5a};
+        hid_write(dev, cmd, 3);
+        hid_close(dev);
+        hid_exit();
+        usleep(PS_USB_REBOOT_MS * 1000);
+    }
+    
+    if (held)
+        handle = hid_open(0x4D8, 0xEC42, nullptr);
+    else
+        usbLock(false);
+}
+
+//************************************************
+void PSCTL::usbChange(PS_USB_STATE state)
+{
+    if (state == usb)
+        return;
+    
+    // the Power*Star restarted, or may have lost power
+    if (state == PS_USB_REBOOT || state == PS_USB_LOST) {
+        restorePending = true;
+        dropCached();
+    }
+    
+    usb = state;
+    if (usbEvents.size() == PS_USB_EVENTS)
+        usbEvents.pop_front();
+    usbEvents.push_back({psTimeMs(), state});
+}
+
+//************************************************
+bool PSCTL::nextUsbEvent(psUsbEvent &event)
+{
+    if (usbEvents.empty())
+        return false;
+    
+    event = usbEvents.front();
+    usbEvents.pop_front();
+    return true;
+}
+
+//************************************************
+// Opens the Power*Star and keeps it (and the USB lock) until hidEnd
+bool PSCTL::hidBegin()
+{
+    // nested, the outermost hidEnd closes it
+    if (held) {
+        sessions++;
+        return true;
+    }
+    
+    if (usbLock(true))
+        dropCached();
+    handle = hid_open(0x4D8, 0xEC42, nullptr);
+    if (handle == nullptr) {
+        hid_exit();
+        usbLock(false);
+        return false;
+    }
+    
+    held = true;
+    sessions = 1;
+    return true;
+}
+
+//************************************************
+void PSCTL::hidEnd()
+{
+    if ( ! held || --sessions > 0)
+        return;
+    
+    held = false;
+    hidDone();
+}
+
+//************************************************
+// Close out the USB unless a session holds it
+void PSCTL::hidDone()
+{
+    if (held)
+        return;
+    
+    hid_close(handle);
+    handle = nullptr;
+    hid_exit();
+    usbLock(false);
+}
+
+//************************************************
+uint8_t* PSCTL::hidIO(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd)
 {
     int rc       = 0;
-    static uint8_t hRes[3] = {0};
+    static uint8_t hRes[psReplyMax()] = {0};
+    static_assert(sizeof(hRes) <= sizeof(psCached::res), "the read cache keeps whole replies");
     uint8_t hidcmd[3] = {0};
     hidcmd[0] = hcmd;
     hidcmd[1] = hidArg1;
     hidcmd[2] = hidArg2;
     
-    handle = hid_open(0x4D8, 0xEC42, nullptr);
-    if (handle == nullptr) {
-        hRes[0] = 0xFF;
-        hid_close(handle);
-        hid_exit();
-        return hRes;
+    if ( ! held || handle == nullptr) {
+        if ( ! held && usbLock(true))
+            dropCached();
+        handle = hid_open(0x4D8, 0xEC42, nullptr);
+        if (handle == nullptr) {
+            hRes[0] = 0xFF;
+            hidDone();
+            return hRes;
+        }
     }
 
     rc = hid_write(handle, hidcmd, numCmd);
@@ -693,23 +1933,20 @@ uint8_t* PSCTL::hidCMD(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int n
     if (rc < 0)
     {
         hRes[0] = 0xff;
-        hid_close(handle);
-        hid_exit();
+        hidDone();
         return hRes;
     }
 
-    rc = hid_read_timeout(handle, hRes, 3, PS_TIMEOUT);
-    if (rc < 0)
+    // nothing back in time is a failure too, not the last reply again
+    rc = hid_read_timeout(handle, hRes, sizeof(hRes), PS_TIMEOUT);
+    if (rc <= 0)
     {
         hRes[0] = 0xff;
-        hid_close(handle);
-        hid_exit();
+        hidDone();
         return hRes;
     }
     
-    // Close out the USB
-    hid_close(handle);
-    hid_exit();
+    hidDone();
     return hRes;
 }
 
@@ -718,50 +1955,100 @@ uint8_t* PSCTL::hidCMD(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int n
 //******************************************************************
 
 //******************************************************************
-bool PSCTL::MoveAbsFocuser(uint32_t targetTicks)
+// 20 bit resolution position: 4 high bits, then the lower 16 bits
+static psStep positionHigh(uint32_t ticks)
 {
-    bool rc = setAbsPosition(targetTicks);
+    return psSend<PSCTL::PS_SET_HBITS>((ticks >> 16) & 0x0f);
+}
 
-    if (!rc)
-        return false;
+static psStep positionLow(uint32_t ticks)
+{
+    return psSend<PSCTL::PS_SET_POS>(ticks & 0xff, (ticks >> 8) & 0xff);
+}
 
-    targetPosition = targetTicks;
+// The command of step i of a focuser operation: the position, then
+// what to do with it
+static psStep focusCommand(PS_FOCUS_OP op, uint32_t ticks, uint8_t i)
+{
+    if (i == 0)
+        return positionHigh(ticks);
+    if (i == 1)
+        return positionLow(ticks);
     
-    uint8_t* hrc = hidCMD(PS_MTR_CMD, PS_GOTO, 0x00, 2);
+    if (op == PS_FOCUS_MOVE)
+        return psSend<PSCTL::PS_MTR_CMD>(PSCTL::PS_GOTO);
+    else if (op == PS_FOCUS_SYNC)
+        return psSend<PSCTL::PS_MTR_CMD>(PSCTL::PS_CMD_POS, 0x00, true);
+    else
+        return psSend<PSCTL::PS_MTR_CMD>(PSCTL::PS_CMD_MAX, 0x00, true);
+}
 
-    if (hrc < 0)
+//******************************************************************
+bool PSCTL::startFocus(PS_FOCUS_OP op, uint32_t ticks)
+{
+    if (focusBusy())
         return false;
-
+    
+    focusQueued = op;
+    focusTicks = ticks;
+    focusCount = op == PS_FOCUS_SET_POS ? 2 : 3;
+    focusNext = 0;
     return true;
 }
 
 //******************************************************************
-bool PSCTL::setPosition(uint32_t ticks, uint8_t cmdCode)
-{    
-    uint8_t setTicks1;
-    uint8_t setTicks2;
-
-    // 20 bit resolution position. 4 high bits + 16 lower bits
-    // Send 4 high bits first
-    setTicks1 = (ticks & 0x40000) >> 16;
-
-
-    response = hidCMD(PS_SET_HBITS, setTicks1, 0x00, 2);
+// Send the next command of the queued operation; one that isn't answered,
+// is refused or doesn't reply 0 when it has to drops the rest
+PS_FOCUS_STATE PSCTL::focusStep()
+{
+    if ( ! focusBusy())
+        return PS_FOCUS_IDLE;
     
-    if ( response[1] == 0xff )
-    {
-        return false;
+    psStep step = focusCommand(focusQueued, focusTicks, focusNext);
+    uint16_t value = 0;
+    response = hidCMD((PS_COMMANDS)step.cmd->opcode, step.arg1, step.arg2, step.cmd->request);
+    if ( ! commandOk(*step.cmd, response, &value) || (step.zero && value != 0)) {
+        cancelFocus();
+        return PS_FOCUS_FAILED;
     }
+    
+    if (++focusNext < focusCount)
+        return PS_FOCUS_RUNNING;
+    
+    cancelFocus();
+    if (focusQueued != PS_FOCUS_SET_MAX)
+        targetPosition = focusTicks;
+    if (focusQueued == PS_FOCUS_SYNC)
+        simPosition = focusTicks;
+    return PS_FOCUS_DONE;
+}
 
-    // Send lower 16 bit
-    setTicks1 = ticks & 0xFF;             // Low Byte
-    setTicks2 = (ticks & 0xFF00) >> 8;    // High Byte
-
-    response = hidCMD(PS_SET_POS, setTicks1, setTicks2, 3);
+//******************************************************************
+// What's left of the queued operation in one USB session
+bool PSCTL::finishFocus()
+{
+    PS_FOCUS_STATE state = PS_FOCUS_IDLE;
+    
+    bool session = hidBegin();
+    while (focusBusy())
+        state = focusStep();
+    if (session)
+        hidEnd();
+    
+    return state == PS_FOCUS_DONE;
+}
 
-    targetPosition = ticks;
+//******************************************************************
+bool PSCTL::MoveAbsFocuser(uint32_t targetTicks)
+{
+    return startFocus(PS_FOCUS_MOVE, targetTicks) && finishFocus();
+}
 
-    return true;
+//******************************************************************
+// cmdCode isn't sent, PS_CMD_POS or PS_CMD_MAX after it says which
+bool PSCTL::setPosition(uint32_t ticks, uint8_t cmdCode)
+{    
+    return startFocus(PS_FOCUS_SET_POS, ticks) && finishFocus();
 }
 
 //******************************************************************
@@ -781,10 +2068,11 @@ bool PSCTL::getPosition(uint32_t *ticks, uint8_t cmdCode)
     else
         posType = PS_MAX; //get max position
 
-    response = hidCMD(PS_GET_HBITS, posType, 0x00, 2);
+    uint16_t bits = 0;
+    command<PS_GET_HBITS>(posType, 0x00, &bits);
 
     // Store 4 high bits part of a 20 bit number
-    pos = response[1] << 16;
+    pos = bits << 16;
 
     // Get 16 lower bits
     if (cmdCode == PS_GET_POS)
@@ -792,12 +2080,16 @@ bool PSCTL::getPosition(uint32_t *ticks, uint8_t cmdCode)
     else
         posType = PS_MAX; //get max position
 
-    response = hidCMD(PS_GET_POS, posType, 0x00, 3);
+    bits = 0;
+    command<PS_GET_POS>(posType, 0x00, &bits);
 
-    // response[1] is lower byte and response[2] is high byte. Combine and add to ticks.
-    pos |= response[1] | response[2] << 8;
+    // lower 16 bits
+    pos |= bits;
 
     *ticks = pos;
+    
+    if (metrics && cmdCode == PS_GET_POS)
+        metrics->setPosition(pos);
 
     return true;
 }
@@ -829,19 +2121,27 @@ bool PSCTL::getMaxPosition(uint32_t *ticks)
 //******************************************************************
 uint8_t PSCTL::getFocusStatus()
 {
-    response = hidCMD(PS_GET_STATUS, 0x00, 0x00, 1);
+    uint16_t status = 4;    // unknown if it doesn't answer
+    command<PS_GET_STATUS>(0x00, 0x00, &status);
 
-    if (response[1] > 5)
-        response[1] = 4;
+    if (status > 5)
+        status = 4;
 
-    return response[1];
+    if (metrics)
+        metrics->setMotor(status);
+    
+    return status;
 }
 
 //******************************************************************
+// Drops what's left of a queued operation before halting the motor
 bool PSCTL::AbortFocuser()
 {    
-    uint8_t* hres = hidCMD(PS_MTR_CMD, PS_HALT, 0x00, 2);
-    if (hres[1] == 0)
+    cancelFocus();
+    
+    uint16_t rc = 0xff;
+    command<PS_MTR_CMD>(PS_HALT, 0x00, &rc);
+    if (rc == 0)
         return true;
     else
         return false;
@@ -850,56 +2150,25 @@ bool PSCTL::AbortFocuser()
 //******************************************************************
 bool PSCTL::SyncFocuser(uint32_t ticks)
 {
-    bool rc = setAbsPosition(ticks);
-
-    if (!rc)
-        return false;
-
-    simPosition = ticks;
-
-    uint8_t* hrc = hidCMD(PS_MTR_CMD, PS_CMD_POS, 0x00, 2);
-
-    if (hrc[1] == 0)
-        return true;
-    else
-        return false;
+    return startFocus(PS_FOCUS_SYNC, ticks) && finishFocus();
 }
 
 //******************************************************************
 bool PSCTL::SetFocuserMaxPosition(uint32_t ticks)
 {
-    bool rc = setMaxPosition(ticks);
-
-
-    if (!rc)
-        return false;
-    
-    uint8_t* hrc = hidCMD(PS_MTR_CMD, PS_CMD_MAX, 0x00, 2);
-
-    if (hrc[1] == 0)
-        return true;
-    else
-        return false;
+    return startFocus(PS_FOCUS_SET_MAX, ticks) && finishFocus();
 }
 
 //******************************************************************
 bool PSCTL::lockFocusMtr()
 {
-    response = hidCMD(PS_SET_MTRLCK, 0xa5, 0x00, 3);
-    if (response[1] == 0xff)
-        return false;
-    
-    return true;
+    return command<PS_SET_MTRLCK>(0xa5, 0x00);
 }
 
 //******************************************************************
 bool PSCTL::unLockFocusMtr()
 {
-    response = hidCMD(PS_SET_MTRLCK, 0x5a, 0x02, 3);
-    if (response[1] == 0xff)
-        return false;
-    
-    return true;
+    return command<PS_SET_MTRLCK>(0x5a, 0x02);
 }
 
 
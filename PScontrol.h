@@ -10,6 +10,7 @@
 #include "hidapi.h"
 #include <map>
 #include <vector>
+#include <deque>
 using namespace std;
 
 
@@ -52,6 +53,163 @@ typedef struct {
             char     usb6[11];
 } PowerStarProfile;
 
+// Telemetry channels decoded by getStatus, in snapshot (column) order
+typedef enum { PS_CH_PORTS,          // port/usb on mask (PS_PORT_STATUS)
+               PS_CH_AUTOBOOT,       // autoboot mask (PS_GET_AUTO)
+               PS_CH_DEW1_SET,
+               PS_CH_DEW2_SET,
+               PS_CH_IN_V,
+               PS_CH_VAR_V,
+               PS_CH_INT_V,
+               PS_CH_OUT1_A,
+               PS_CH_OUT2_A,
+               PS_CH_OUT3_A,
+               PS_CH_OUT4_A,
+               PS_CH_DEW1_A,
+               PS_CH_DEW2_A,
+               PS_CH_VAR_A,
+               PS_CH_MP_A,
+               PS_CH_IN_A,
+               PS_CH_TEMP,
+               PS_CH_HUM,
+               PS_CH_VAR_SET,
+               PS_CH_MP_MODE,
+               PS_CH_LED,
+               PS_CH_FM,
+               PS_NCHAN
+} PS_CHANNEL;
+
+typedef struct {
+            const char *name;
+            const char *unit;
+            float       resolution;    // smallest step kept by the archive
+} psChannel;
+
+extern const psChannel psChannels[PS_NCHAN];
+
+// One decoded getStatus pass
+typedef struct {
+            uint64_t time;             // ms since epoch
+            float    value[PS_NCHAN];
+} psSample;
+
+uint64_t psTimeMs();
+
+#define PS_FAULT_EVENTS     64          // transitions kept until taken
+
+// A change of the getFaultStatus bitset
+typedef struct {
+            uint64_t time;             // ms since epoch
+            uint32_t raised;           // bits that came on
+            uint32_t cleared;          // bits that went off
+            uint32_t faults;           // bitset after the change
+} psFaultEvent;
+
+// USB watchdog: every PS_USB_FAIL_MAX failed commands in a row, whatever
+// they were, go one step further down these until the Power*Star answers
+typedef enum { PS_USB_OK,
+               PS_USB_REOPEN,          // new libusb context and handle
+               PS_USB_RESET,           // libusb_reset_device on the port
+               PS_USB_REBOOT,          // PS_RESET to the Power*Star, only if allowed
+               PS_USB_LOST             // gave up, retried every PS_USB_RETRY_MS
+} PS_USB_STATE;
+
+#define PS_USB_FAIL_MAX     3
+#define PS_USB_DEADLINE_MS  250         // a reply slower than this is a miss
+#define PS_USB_SLOW_MAX     3           // in a row, then a port reset
+#define PS_USB_SETTLE_MS    1500        // re-enumeration after a port reset
+#define PS_USB_REBOOT_MS    4000        // Power*Star restart after PS_RESET
+#define PS_USB_RETRY_MS     10000
+#define PS_USB_EVENTS       16
+
+extern const char *psUsbStates[PS_USB_LOST + 1];
+
+typedef struct {
+            uint64_t time;             // ms since epoch
+            PS_USB_STATE state;
+} psUsbEvent;
+
+// Write-through copies of the packed registers the setters modify,
+// refreshed by every poll and read again once older than PS_SHADOW_MS,
+// or when another process held the USB lock last
+typedef enum { PS_REG_PORTS,           // PS_PORT_STATUS / PS_PORT_CTL
+               PS_REG_AUTO,            // PS_GET_AUTO / PS_SET_AUTO
+               PS_REG_MTR_LED,         // PS_GET_MTR_LED / PS_SET_MTR_LED
+               PS_NREGS
+} PS_REGISTER;
+
+#define PS_SHADOW_MS        10000
+
+typedef struct {
+            uint8_t  lo;
+            uint8_t  hi;
+            uint64_t time;             // ms since epoch, 0: unknown
+} psRegister;
+
+// The settings activateProfile makes, in the order it makes them; all
+// but the lock are registers it reads back
+typedef enum { PS_PROFILE_MTR_TYPE,    // PS_SET_MTR_LED high byte
+               PS_PROFILE_REVERSE,
+               PS_PROFILE_BACKLASH,    // amount, preferred direction
+               PS_PROFILE_TCOMP,
+               PS_PROFILE_TMPCO,
+               PS_PROFILE_HYS,
+               PS_PROFILE_SPERIOD,
+               PS_PROFILE_MTRCUR,
+               PS_PROFILE_LOCK,        // unlocked with the braking level
+               PS_PROFILE_NFIELDS
+} PS_PROFILE_FIELD;
+
+// How each went
+typedef enum { PS_APPLY_SAME,          // already as asked, not written
+               PS_APPLY_WRITTEN,       // written and read back as asked
+               PS_APPLY_FAILED,        // refused, unanswered or read back wrong
+               PS_APPLY_RESTORED,      // written, then put back as it was
+               PS_APPLY_SKIPPED        // not got to
+} PS_APPLY;
+
+extern const char *psProfileFields[PS_PROFILE_NFIELDS];
+
+// getProfileStatus fields: 1 << PS_PROFILE_FIELD for the registers, and
+#define PS_READ_POSITION    (1u << PS_PROFILE_NFIELDS)
+#define PS_READ_MAX         (1u << (PS_PROFILE_NFIELDS + 1))
+#define PS_READ_ALL         0xffffffffu
+
+// Read cache freshness by kind of read, see cacheTtl() in PScontrol.cpp
+#define PS_CACHE_STATUS_MS  1000        // ports, dew, volts, amps, VAR, PWM, MP/LED
+#define PS_CACHE_FAULT_MS   500
+#define PS_CACHE_SETUP_MS   5000        // focuser setup, user limits, weather
+#define PS_CACHE_VERSION_MS 3600000
+
+typedef struct {
+            uint8_t  res[3];
+            uint64_t time;             // ms since epoch
+} psCached;
+
+// Focuser operations, queued by startFocus and sent one command per
+// focusStep so a caller's timer can do other I/O and abort in between
+typedef enum { PS_FOCUS_MOVE,          // position, then PS_GOTO
+               PS_FOCUS_SYNC,          // position, then PS_CMD_POS
+               PS_FOCUS_SET_MAX,       // position, then PS_CMD_MAX
+               PS_FOCUS_SET_POS        // position only
+} PS_FOCUS_OP;
+
+typedef enum { PS_FOCUS_IDLE,          // nothing queued
+               PS_FOCUS_RUNNING,       // sent one, more to go
+               PS_FOCUS_DONE,          // sent the last one
+               PS_FOCUS_FAILED         // one failed, the rest dropped
+} PS_FOCUS_STATE;
+
+class PSARCHIVE;
+class PSENERGY;
+class PSSHARED;
+class PSMETRICS;
+class PSRECORDER;
+class PSRULES;
+class PSJOURNAL;
+class PSBUDGET;
+struct psBatchRead;
+
 class PSCTL
 {
     public:
@@ -147,6 +305,10 @@ class PSCTL
 
         map <string, statusData> statusMap;
         map <string, statusData> :: iterator itr;
+        vector<statusData*> portData;  // statusMap entry of each psPorts row
+        
+        // latest getStatus pass as a flat record
+        psSample sample {};
         
         const char *getDefaultName();
         bool    initProperties();
@@ -159,26 +321,107 @@ class PSCTL
         bool    SyncFocuser(uint32_t ticks);
         bool    SetFocuserMaxPosition(uint32_t ticks);
         
+        // Queue a focuser operation, false while another is queued; then
+        // focusStep once per tick, or finishFocus to block until it's done.
+        // AbortFocuser and cancelFocus drop what's left of it
+        bool    startFocus(PS_FOCUS_OP op, uint32_t ticks);
+        PS_FOCUS_STATE focusStep();
+        bool    finishFocus();
+        bool    focusBusy() { return focusNext < focusCount; }
+        PS_FOCUS_OP focusOp() { return focusQueued; }
+        uint32_t focusTarget() { return focusTicks; }
+        void    cancelFocus() { focusNext = focusCount = 0; }
+        
         bool    Connect();
         bool    Disconnect();
+        
+        // Telemetry archive, appended to on every getStatus
+        bool    openArchive(const char *path);
+        void    closeArchive();
+        bool    isArchiving() { return archive != nullptr; }
+        
+        // Amp-hour / watt-hour counters, updated on every getStatus
+        bool    openEnergy(const char *path);
+        void    closeEnergy();
+        PSENERGY *energyMeter() { return energy; }
+        bool    getEnergy(double *ah, double *wh, uint64_t *since);
+        
+        // Shared-memory status, one process polls and publishes, others read
+        bool    openShared();
+        void    closeShared();
+        bool    sharedReader();
+        
+        // OpenMetrics exporter, serves the last poll and command counters
+        bool    openMetrics(const char *listen);
+        void    closeMetrics();
+        bool    isExporting() { return metrics != nullptr; }
+        
+        // Fault flight recorder, captures before and after each fault edge
+        bool    openRecorder(const char *dir);
+        void    closeRecorder();
+        bool    isRecording() { return recorder != nullptr; }
+        bool    nextCapture(string &path);
+        
+        // Desired-state journal, re-applied after a Power*Star reset
+        bool    openJournal(const char *path);
+        void    closeJournal();
+        bool    nextRestore(string &what);
+        bool    restoreDue() { return restorePending; }
+        
+        // Alert rules, evaluated on every getStatus
+        bool    openRules(const char *path, string &error);
+        void    closeRules();
+        PSRULES *alertRules() { return rules; }
+        
+        // Power budget, port/dew/PWM/VAR commands that would overdraw the
+        // supply are refused or deferred
+        bool    openBudget(const char *path, string &error);
+        void    closeBudget();
+        PSBUDGET *powerBudget() { return budget; }
+        bool    nextBudgetNote(string &note);
+
+        // Held USB session, commands reuse one open handle until hidEnd;
+        // sessions nest, the outermost hidEnd closes it
+        bool    hidBegin();
+        void    hidEnd();
+        
+        // USB watchdog state and its unread changes
+        PS_USB_STATE usbState() { return usb; }
+        // PS_RESET power cycles every output, the watchdog only sends it if allowed
+        void    allowUsbReboot(bool allow) { usbReboot = allow; }
+        bool    nextUsbEvent(psUsbEvent &event);
 
         uint8_t  getFocusStatus();
         uint16_t getPWM();
+        bool     getCurrent(uint8_t port, float *amps);
+        bool     getVolts(uint8_t channel, float *volts);
+        bool     getPortStatus(uint16_t *portStatus);
         uint8_t  getDew(uint8_t device);
         uint32_t getFaultStatus(uint16_t mask);
         void     clearFaultStatus();
-        PowerStarProfile    getProfileStatus();
+        bool     nextFaultEvent(psFaultEvent &event);
+        uint32_t faultBits() { return faults; }
+        PowerStarProfile    getProfileStatus(uint32_t fields = PS_READ_ALL);
 
         bool     setDew(uint8_t channel, uint8_t percent);
         bool     setPWM(uint16_t pwmamt);
-        bool     setPowerState(const string &device, const string &action);
+        // false only if the write failed, ports the budget turned down
+        // (see nextBudgetNote) are left off and set in refused
+        bool     setPowerState(const string &device, const string &action, uint16_t *refused = nullptr);
+        bool     setPowerStates(uint16_t on, uint16_t off, uint16_t *refused = nullptr);
+        bool     setPortStatus(uint16_t portStatus, uint16_t *refused = nullptr);
+        bool     cutPorts(uint16_t off);
         bool     setAutoBoot(string &device, string &action);
+        bool     setAutoBoots(uint16_t on, uint16_t off);
+        static bool portMask(const string &devices, bool autoboot, uint16_t *mask);
         bool     setVar(uint8_t voltage);
         bool     setLED(uint8_t brightness);
         bool     setMultiPort(uint8_t MPtype);
         bool     saveDewPwmFault(PowerStarProfile psProfile);
         
         bool     activateProfile(PowerStarProfile psProfile);
+        PS_APPLY profileApplied[PS_PROFILE_NFIELDS] {};
+        string   profileReport();
 
         bool     clearFaults();
         bool     restart();
@@ -220,13 +463,88 @@ class PSCTL
         
         int32_t simPosition { 0 };
         uint32_t targetPosition { 0 };
+        
+        // the queued focuser operation, focusNext of its focusCount commands sent
+        PS_FOCUS_OP focusQueued { PS_FOCUS_MOVE };
+        uint32_t focusTicks { 0 };
+        uint8_t  focusCount { 0 };
+        uint8_t  focusNext { 0 };
         uint8_t* response = {0};
         
         bool isConnected;
         
+        PSARCHIVE *archive { nullptr };
+        PSENERGY  *energy { nullptr };
+        PSSHARED  *shared { nullptr };
+        PSMETRICS *metrics { nullptr };
+        PSRECORDER *recorder { nullptr };
+        PSRULES   *rules { nullptr };
+        PSJOURNAL *journal { nullptr };
+        PSBUDGET  *budget { nullptr };
+        
+        // a reset was seen, put the journal back on the next poll
+        bool    restorePending { false };
+        string  restored;
+        void    restoreState();
+        
+        void    loadStatus();
+        
+        // register shadows, dropped when the device may have changed them
+        psRegister shadow[PS_NREGS] {};
+        bool    getRegister(PS_REGISTER reg, uint8_t *lo, uint8_t *hi);
+        void    shadowCommand(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, const uint8_t *res);
+        void    shadowSample();
+        void    dropCached();
+        
+        // answered reads by (opcode, args), dropped by the writes they follow
+        map<uint32_t, psCached> readCache;
+        uint8_t  cacheReply[3];
+        uint8_t* hidRead(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd);
+        void    cacheCommand(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, const uint8_t *res);
+        void    dropReads(uint8_t hcmd);
+        
+        // a setting the NVM commit saves was written since the last one,
+        // and the braking the motor was last unlocked with (-1: unknown)
+        bool    nvmDirty { false };
+        int16_t brakingSent { -1 };
+        void    nvmCommand(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2);
+        
+        // budget check of one port's new draw, deferred or noted if refused
+        deque<string> budgetNotes;
+        bool    admit(uint8_t port, int kind, uint16_t value);
+        void    budgetNote(const string &note);
+        void    retryDeferred();
+        
+        // fault bitset of the last poll and its unread transitions
+        uint32_t faults { 0 };
+        deque<psFaultEvent> faultEvents;
+        void    applyFaults(uint32_t now);
+        
+        // typed commands from psCommands (PScommands.h), false if not answered
+        // or refused; the reply stays in response
+        template <PS_COMMANDS OP> bool command(uint8_t hidArg1 = 0, uint8_t hidArg2 = 0, uint16_t *value = nullptr);
+        template <PS_COMMANDS OP> bool cached(uint8_t hidArg1 = 0, uint8_t hidArg2 = 0, uint16_t *value = nullptr);
+        template <size_t N> uint32_t runBatch(const psBatchRead (&plan)[N], uint16_t (&values)[N], bool cache = false, uint32_t select = ~0u);
+        bool    command(const psBatchRead &write);
+        
         uint8_t* hidCMD(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd);
+        uint8_t* hidTimed(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd);
+        uint8_t* hidIO(PS_COMMANDS hcmd, uint8_t hidArg1, uint8_t hidArg2, int numCmd);
+        void    hidDone();
+        
+        PS_USB_STATE usb { PS_USB_OK };
+        int      usbSlow { 0 };            // slow replies in a row
+        int      usbFails { 0 };           // failed commands in a row
+        bool     usbReboot { false };
+        uint64_t usbRetryAt { 0 };
+        deque<psUsbEvent> usbEvents;
+        void    usbChange(PS_USB_STATE state);
+        void    usbRecover(PS_USB_STATE step);
+        PS_USB_STATE usbEscalate();
         
         hid_device *handle { nullptr };
+        bool        held { false };
+        int         sessions { 0 };        // hidBegin calls not yet ended
 
         // Driver Timeout in ms
         static const uint16_t PS_TIMEOUT { 1000 };
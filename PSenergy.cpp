@@ -0,0 +1,105 @@
+/***************************************************************
+*  Program:      PSenergy.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star amp-hour / watt-hour accounting
+****************************************************************/
+
+#include "PSenergy.h"
+#include "PSports.h"
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+//******************************************************************
+PSENERGY::PSENERGY()
+{
+    memset(&totals, 0, sizeof(totals));
+    totals.magic = PSE_MAGIC;
+}
+
+//******************************************************************
+// Load saved counters, a missing file starts from zero
+bool PSENERGY::open(const char *path)
+{
+    file = path;
+    haveLast = false;
+    lastSave = psTimeMs();
+
+    psEnergy saved;
+    FILE *fin = fopen(path, "r");
+    if (fin) {
+        if (fread(&saved, sizeof(saved), 1, fin) == 1 && saved.magic == PSE_MAGIC)
+            totals = saved;
+        fclose(fin);
+        return true;
+    }
+
+    reset();
+    return save();
+}
+
+//******************************************************************
+void PSENERGY::close()
+{
+    if ( ! file.empty())
+        save();
+    haveLast = false;
+}
+
+//******************************************************************
+// write-then-rename so a crash never leaves a half written file
+bool PSENERGY::save()
+{
+    if (file.empty())
+        return false;
+
+    string tmp = file + ".tmp";
+    FILE *fout = fopen(tmp.c_str(), "w");
+    if ( ! fout)
+        return false;
+
+    bool ok = fwrite(&totals, sizeof(totals), 1, fout) == 1;
+    ok = (fclose(fout) == 0) && ok;
+    if (ok)
+        ok = rename(tmp.c_str(), file.c_str()) == 0;
+
+    lastSave = psTimeMs();
+    return ok;
+}
+
+//******************************************************************
+void PSENERGY::reset()
+{
+    memset(&totals, 0, sizeof(totals));
+    totals.magic = PSE_MAGIC;
+    totals.since = psTimeMs();
+    haveLast = false;
+
+    if ( ! file.empty())
+        save();
+}
+
+//******************************************************************
+void PSENERGY::update(const psSample &sample)
+{
+    if (haveLast && sample.time > last.time && sample.time - last.time <= PSE_MAX_GAP_MS) {
+        double hours = (sample.time - last.time) / 3600000.0;
+
+        for (int p = 0; p < PSE_NPORTS; p++) {
+            // Var has its own regulator, everything else runs at the input voltage
+            PS_CHANNEL volts = (p == PSE_VAR) ? PS_CH_VAR_V : PS_CH_IN_V;
+            float i0 = last.value[psPorts[p].amps];
+            float i1 = sample.value[psPorts[p].amps];
+
+            totals.ah[p] += (i0 + i1) / 2 * hours;
+            totals.wh[p] += (i0 * last.value[volts] + i1 * sample.value[volts]) / 2 * hours;
+        }
+    }
+
+    last = sample;
+    haveLast = true;
+
+    if (sample.time - lastSave >= PSE_SAVE_SECS * 1000ULL)
+        save();
+}
@@ -0,0 +1,62 @@
+/***************************************************************
+*  Program:      PSenergy.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star amp-hour / watt-hour accounting .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <string>
+
+#define PS_ENERGY_FILE      "/etc/powerstar.energy"
+
+#define PSE_MAGIC           0x45535350      // "PSSE"
+#define PSE_MAX_GAP_MS      60000           // don't integrate across a longer gap
+#define PSE_SAVE_SECS       300
+
+// Metered ports, PSE_IN is the total drawn from the supply
+typedef enum { PSE_OUT1,
+               PSE_OUT2,
+               PSE_OUT3,
+               PSE_OUT4,
+               PSE_DEW1,
+               PSE_DEW2,
+               PSE_VAR,
+               PSE_MP,
+               PSE_IN,
+               PSE_NPORTS
+} PSE_PORT;
+
+typedef struct {
+            uint32_t magic;
+            uint64_t since;                 // ms since epoch of last reset
+            double   ah[PSE_NPORTS];
+            double   wh[PSE_NPORTS];
+} psEnergy;
+
+class PSENERGY
+{
+    public:
+        PSENERGY();
+
+        bool    open(const char *path);
+        void    close();
+        bool    save();
+        void    reset();
+
+        // trapezoidal step from the previous sample
+        void    update(const psSample &sample);
+
+        double   ampHours(int port) { return totals.ah[port]; }
+        double   wattHours(int port) { return totals.wh[port]; }
+        uint64_t since() { return totals.since; }
+
+    private:
+        string   file;
+        psEnergy totals;
+        psSample last;
+        bool     haveLast { false };
+        uint64_t lastSave { 0 };
+};
@@ -0,0 +1,85 @@
+/***************************************************************
+*  Program:      PSfaults.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star fault bit table
+****************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Meaning of every bit of the getFaultStatus word: level 1 (PS_FAULT1,
+ * non fatal) in the low 16 bits, level 2 (PS_FAULT2, fatal, needs a
+ * restart) in the high 16.  Bytes are in the order the device returns
+ * them.  port is the statusMap entry whose fault1/fault2 flag the bit
+ * sets.  Unused bits have a null message.
+ */
+
+typedef enum { PS_FAULT_WARN = 1,       // level 1
+               PS_FAULT_FATAL = 2       // level 2
+} PS_FAULT_SEVERITY;
+
+typedef struct {
+            PS_FAULT_SEVERITY severity;
+            const char *port;
+            const char *message;
+} psFault;
+
+constexpr psFault psFaults[32] = {
+        // level 1 byte 1
+        { PS_FAULT_WARN,  nullptr, nullptr },
+        { PS_FAULT_WARN,  "IN",   "Over/Under Voltage on 12V input" },
+        { PS_FAULT_WARN,  "IN",   "Over Current on 12V Input" },
+        { PS_FAULT_WARN,  "FM",   "Motor temperature sensor" },
+        { PS_FAULT_WARN,  "Bip",  "Bipolar Motor" },
+        { PS_FAULT_WARN,  "Int",  "Internal voltage out of spec" },
+        { PS_FAULT_WARN,  "Temp", "Environment sensor" },
+        { PS_FAULT_WARN,  "Var",  "Variable voltage over/under voltage by 6.25%" },
+        // level 1 byte 2
+        { PS_FAULT_WARN,  "Out1", "Out1 over 15A" },
+        { PS_FAULT_WARN,  "Out2", "Out2 over 10A" },
+        { PS_FAULT_WARN,  "Out3", "Out3 over 6A" },
+        { PS_FAULT_WARN,  "Out4", "Out4 over 6A" },
+        { PS_FAULT_WARN,  "Dew1", "Dew1 over 6A" },
+        { PS_FAULT_WARN,  "Dew2", "Dew2 over 6A" },
+        { PS_FAULT_WARN,  "MP",   "MP over 6A" },
+        { PS_FAULT_WARN,  "FM",   "Position Change" },
+        // level 2 byte 1
+        { PS_FAULT_FATAL, "Out1", "Out1 over 30A" },
+        { PS_FAULT_FATAL, "Out2", "Out2 over 20A" },
+        { PS_FAULT_FATAL, "Out3", "Out3 over 10A" },
+        { PS_FAULT_FATAL, "Out4", "Out4 over 10A" },
+        { PS_FAULT_FATAL, "Dew1", "Dew1 over 10A" },
+        { PS_FAULT_FATAL, "Dew2", "Dew2 over 10A" },
+        { PS_FAULT_FATAL, "Var",  "VAR over 10A" },
+        { PS_FAULT_FATAL, "MP",   "MP over 10A" },
+        // level 2 byte 2
+        { PS_FAULT_FATAL, "IN",   "12V input under-voltage" },
+        { PS_FAULT_FATAL, "IN",   "12V input over-voltage" },
+        { PS_FAULT_FATAL, "IN",   "Total current over-current" },
+        { PS_FAULT_FATAL, "IN",   "Current sensor" },
+        { PS_FAULT_FATAL, "Int",  "Internal 3.3V under-voltage" },
+        { PS_FAULT_FATAL, "Int",  "Internal 3.3V over-voltage" },
+        { PS_FAULT_FATAL, "Int",  "Internal 5V under-voltage" },
+        { PS_FAULT_FATAL, nullptr, nullptr }
+        };
+
+#define PS_FAULT_LEVEL1     0x0000ffffu
+#define PS_FAULT_LEVEL2     0xffff0000u
+#define PS_FAULT_POSITION   0x00008000u     // FM Position Change, raised when the Power*Star restarts
+
+// Bit numbers of the active faults in faults, lowest first; returns the count
+inline int psDecodeFaults(uint32_t faults, uint8_t bits[32])
+{
+    int n = 0;
+
+    while (faults) {
+        int bit = __builtin_ctz(faults);
+        faults &= faults - 1;           // drop the lowest set bit
+        if (psFaults[bit].message)
+            bits[n++] = bit;
+    }
+    return n;
+}
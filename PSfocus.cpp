@@ -8,6 +8,7 @@ Requires:   PScontrol.cpp device interface
 #include "PSfocus.h"
 
 #define FOCUS_SETTINGS_TAB "Settings"
+#define TELEMETRY_TAB "Telemetry"
 
 static std::unique_ptr<PWRSTR> pwrhb(new PWRSTR());
 
@@ -66,7 +67,6 @@ PWRSTR::PWRSTR()
 //************************************************************
 bool PWRSTR::Connect()
 {
-    PSCTL psctl;
     if (isSimulation())
     {
         SetTimer(POLLMS);
@@ -106,6 +106,16 @@ bool PWRSTR::Connect()
         uint16_t psversion = psctl.getVersion();
         LOGF_INFO("PowerStar Firmware Version: %i.%i", (psversion & 0xFF00) >> 8, psversion & 0xFF);
         
+        // publish status for pstui and friends, or read it if one of them polls
+        if ( ! psctl.openShared())
+            LOG_WARN("Could not open shared status segment");
+        else if (psctl.sharedReader())
+            LOG_INFO("Using status published by another Power*Star process");
+        
+        // port/dew/VAR/LED settings to put back after a Power*Star reset
+        if ( ! psctl.openJournal(PS_STATE_FILE))
+            LOG_WARN("Could not open desired-state journal " PS_STATE_FILE);
+        
         // read config file and retrieve port names
         FILE* fin = fopen("/etc/powerstar.config", "r");
         int rc = fread(&curProfile, sizeof(PowerStarProfile), 1, fin);     
@@ -153,6 +163,470 @@ bool PWRSTR::initProperties()
     
     addDebugControl();
     
+    // USB watchdog
+    IUFillLight(&UsbL[0], "USB_LINK", "Link", IPS_IDLE);
+    IUFillLightVector(&UsbLP, UsbL, 1, getDeviceName(), "USB_WATCHDOG", "USB", MAIN_CONTROL_TAB, IPS_IDLE);
+    
+    // restarting the Power*Star power cycles every output, so only if asked
+    IUFillSwitch(&UsbRebootS[0], "USB_REBOOT_ON", "On", ISS_OFF);
+    IUFillSwitch(&UsbRebootS[1], "USB_REBOOT_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&UsbRebootSP, UsbRebootS, 2, getDeviceName(), "USB_WATCHDOG_REBOOT", "Restart PS", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    
+    // Telemetry archive
+    IUFillSwitch(&ArchiveS[0], "ARCHIVE_ON", "On", ISS_OFF);
+    IUFillSwitch(&ArchiveS[1], "ARCHIVE_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&ArchiveSP, ArchiveS, 2, getDeviceName(), "TELEMETRY_ARCHIVE", "Archive", TELEMETRY_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    
+    IUFillText(&ArchiveFileT[0], "ARCHIVE_FILE", "File", PS_ARCHIVE_FILE);
+    IUFillTextVector(&ArchiveFileTP, ArchiveFileT, 1, getDeviceName(), "TELEMETRY_ARCHIVE_FILE", "Archive", TELEMETRY_TAB, IP_RW, 60, IPS_IDLE);
+    
+    // Energy accounting
+    IUFillSwitch(&EnergyS[0], "ENERGY_ON", "On", ISS_OFF);
+    IUFillSwitch(&EnergyS[1], "ENERGY_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&EnergySP, EnergyS, 2, getDeviceName(), "TELEMETRY_ENERGY", "Energy", TELEMETRY_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    
+    IUFillSwitch(&EnergyResetS[0], "ENERGY_RESET", "Reset", ISS_OFF);
+    IUFillSwitchVector(&EnergyResetSP, EnergyResetS, 1, getDeviceName(), "TELEMETRY_ENERGY_RESET", "Counters", TELEMETRY_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    
+    IUFillNumber(&EnergyN[0], "ENERGY_AH", "Amp-Hrs", "%.2f", 0, 1e6, 0, 0);
+    IUFillNumber(&EnergyN[1], "ENERGY_WH", "Watt-Hrs", "%.1f", 0, 1e7, 0, 0);
+    IUFillNumberVector(&EnergyNP, EnergyN, 2, getDeviceName(), "TELEMETRY_ENERGY_TOTAL", "Used", TELEMETRY_TAB, IP_RO, 60, IPS_IDLE);
+    
+    // OpenMetrics exporter
+    IUFillSwitch(&MetricsS[0], "METRICS_ON", "On", ISS_OFF);
+    IUFillSwitch(&MetricsS[1], "METRICS_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&MetricsSP, MetricsS, 2, getDeviceName(), "TELEMETRY_METRICS", "Metrics", TELEMETRY_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    
+    IUFillText(&MetricsListenT[0], "METRICS_LISTEN", "Listen", PS_METRICS_LISTEN);
+    IUFillTextVector(&MetricsListenTP, MetricsListenT, 1, getDeviceName(), "TELEMETRY_METRICS_LISTEN", "Metrics", TELEMETRY_TAB, IP_RW, 60, IPS_IDLE);
+    
+    // Fault flight recorder
+    IUFillSwitch(&RecorderS[0], "RECORDER_ON", "On", ISS_OFF);
+    IUFillSwitch(&RecorderS[1], "RECORDER_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&RecorderSP, RecorderS, 2, getDeviceName(), "TELEMETRY_RECORDER", "Fault Rec", TELEMETRY_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    
+    IUFillText(&RecorderDirT[0], "RECORDER_DIR", "Directory", PS_RECORDER_DIR);
+    IUFillTextVector(&RecorderDirTP, RecorderDirT, 1, getDeviceName(), "TELEMETRY_RECORDER_DIR", "Fault Rec", TELEMETRY_TAB, IP_RW, 60, IPS_IDLE);
+    
+    // Alert rules
+    IUFillSwitch(&AlertsS[0], "ALERTS_ON", "On", ISS_OFF);
+    IUFillSwitch(&AlertsS[1], "ALERTS_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&AlertsSP, AlertsS, 2, getDeviceName(), "TELEMETRY_ALERTS", "Alerts", TELEMETRY_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    
+    IUFillText(&AlertsFileT[0], "ALERTS_FILE", "Rules", PS_RULES_FILE);
+    IUFillTextVector(&AlertsFileTP, AlertsFileT, 1, getDeviceName(), "TELEMETRY_ALERTS_FILE", "Alerts", TELEMETRY_TAB, IP_RW, 60, IPS_IDLE);
+    
+    return true;
+}
+
+//************************************************************
+bool PWRSTR::updateProperties()
+{
+    INDI::Focuser::updateProperties();
+    
+    if (isConnected())
+    {
+        UsbL[0].s = IPS_OK;
+        defineLight(&UsbLP);
+        defineSwitch(&UsbRebootSP);
+        loadConfig(true, UsbRebootSP.name);
+        
+        defineText(&ArchiveFileTP);
+        defineSwitch(&ArchiveSP);
+        loadConfig(true, ArchiveFileTP.name);
+        loadConfig(true, ArchiveSP.name);
+        
+        defineSwitch(&EnergySP);
+        defineNumber(&EnergyNP);
+        defineSwitch(&EnergyResetSP);
+        setEnergy(EnergyS[0].s == ISS_ON);
+        loadConfig(true, EnergySP.name);
+        
+        defineText(&MetricsListenTP);
+        defineSwitch(&MetricsSP);
+        loadConfig(true, MetricsListenTP.name);
+        loadConfig(true, MetricsSP.name);
+        
+        defineText(&RecorderDirTP);
+        defineSwitch(&RecorderSP);
+        loadConfig(true, RecorderDirTP.name);
+        loadConfig(true, RecorderSP.name);
+        
+        defineText(&AlertsFileTP);
+        defineSwitch(&AlertsSP);
+        loadConfig(true, AlertsFileTP.name);
+        loadConfig(true, AlertsSP.name);
+    }
+    else
+    {
+        deleteProperty(UsbLP.name);
+        deleteProperty(UsbRebootSP.name);
+        
+        setArchive(false);
+        deleteProperty(ArchiveSP.name);
+        deleteProperty(ArchiveFileTP.name);
+        
+        setEnergy(false);
+        deleteProperty(EnergySP.name);
+        deleteProperty(EnergyNP.name);
+        deleteProperty(EnergyResetSP.name);
+        
+        setMetrics(false);
+        deleteProperty(MetricsSP.name);
+        deleteProperty(MetricsListenTP.name);
+        
+        setRecorder(false);
+        deleteProperty(RecorderSP.name);
+        deleteProperty(RecorderDirTP.name);
+        
+        setAlerts(false);
+        deleteProperty(AlertsSP.name);
+        deleteProperty(AlertsFileTP.name);
+    }
+    
+    return true;
+}
+
+//************************************************************
+bool PWRSTR::ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0)
+    {
+        if (strcmp(name, UsbRebootSP.name) == 0)
+        {
+            IUUpdateSwitch(&UsbRebootSP, states, names, n);
+            psctl.allowUsbReboot(UsbRebootS[0].s == ISS_ON);
+            UsbRebootSP.s = IPS_OK;
+            IDSetSwitch(&UsbRebootSP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, ArchiveSP.name) == 0)
+        {
+            IUUpdateSwitch(&ArchiveSP, states, names, n);
+            bool enable = (ArchiveS[0].s == ISS_ON);
+            
+            if (setArchive(enable))
+                ArchiveSP.s = enable ? IPS_OK : IPS_IDLE;
+            else
+            {
+                IUResetSwitch(&ArchiveSP);
+                ArchiveS[1].s = ISS_ON;
+                ArchiveSP.s = IPS_ALERT;
+            }
+            
+            IDSetSwitch(&ArchiveSP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, EnergySP.name) == 0)
+        {
+            IUUpdateSwitch(&EnergySP, states, names, n);
+            bool enable = (EnergyS[0].s == ISS_ON);
+            
+            if (setEnergy(enable))
+                showEnergy(true);
+            else
+            {
+                IUResetSwitch(&EnergySP);
+                EnergyS[1].s = ISS_ON;
+                EnergySP.s = IPS_ALERT;
+                IDSetSwitch(&EnergySP, nullptr);
+            }
+            
+            return true;
+        }
+        
+        if (strcmp(name, MetricsSP.name) == 0)
+        {
+            IUUpdateSwitch(&MetricsSP, states, names, n);
+            bool enable = (MetricsS[0].s == ISS_ON);
+            
+            if (setMetrics(enable))
+                MetricsSP.s = enable ? IPS_OK : IPS_IDLE;
+            else
+            {
+                IUResetSwitch(&MetricsSP);
+                MetricsS[1].s = ISS_ON;
+                MetricsSP.s = IPS_ALERT;
+            }
+            
+            IDSetSwitch(&MetricsSP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, RecorderSP.name) == 0)
+        {
+            IUUpdateSwitch(&RecorderSP, states, names, n);
+            bool enable = (RecorderS[0].s == ISS_ON);
+            
+            if (setRecorder(enable))
+                RecorderSP.s = enable ? IPS_OK : IPS_IDLE;
+            else
+            {
+                IUResetSwitch(&RecorderSP);
+                RecorderS[1].s = ISS_ON;
+                RecorderSP.s = IPS_ALERT;
+            }
+            
+            IDSetSwitch(&RecorderSP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, AlertsSP.name) == 0)
+        {
+            IUUpdateSwitch(&AlertsSP, states, names, n);
+            bool enable = (AlertsS[0].s == ISS_ON);
+            
+            if (setAlerts(enable))
+                AlertsSP.s = enable ? IPS_OK : IPS_IDLE;
+            else
+            {
+                IUResetSwitch(&AlertsSP);
+                AlertsS[1].s = ISS_ON;
+                AlertsSP.s = IPS_ALERT;
+            }
+            
+            IDSetSwitch(&AlertsSP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, EnergyResetSP.name) == 0)
+        {
+            IUResetSwitch(&EnergyResetSP);
+            
+            PSENERGY *meter = psctl.energyMeter();
+            if (meter)
+            {
+                meter->reset();
+                EnergyN[0].value = EnergyN[1].value = 0;
+                IDSetNumber(&EnergyNP, nullptr);
+                LOG_INFO("Energy counters reset");
+                EnergyResetSP.s = IPS_OK;
+            }
+            else
+                EnergyResetSP.s = IPS_ALERT;
+            
+            IDSetSwitch(&EnergyResetSP, nullptr);
+            return true;
+        }
+    }
+    
+    return INDI::Focuser::ISNewSwitch(dev, name, states, names, n);
+}
+
+//************************************************************
+bool PWRSTR::ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0)
+    {
+        if (strcmp(name, ArchiveFileTP.name) == 0)
+        {
+            IUUpdateText(&ArchiveFileTP, texts, names, n);
+            ArchiveFileTP.s = IPS_OK;
+            
+            // reopen on the new file if already archiving
+            if (psctl.isArchiving() && ! setArchive(true))
+                ArchiveFileTP.s = IPS_ALERT;
+            
+            IDSetText(&ArchiveFileTP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, MetricsListenTP.name) == 0)
+        {
+            IUUpdateText(&MetricsListenTP, texts, names, n);
+            MetricsListenTP.s = IPS_OK;
+            
+            // rebind if already exporting
+            if (psctl.isExporting() && ! setMetrics(true))
+                MetricsListenTP.s = IPS_ALERT;
+            
+            IDSetText(&MetricsListenTP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, RecorderDirTP.name) == 0)
+        {
+            IUUpdateText(&RecorderDirTP, texts, names, n);
+            RecorderDirTP.s = IPS_OK;
+            
+            // move to the new directory if already recording
+            if (psctl.isRecording() && ! setRecorder(true))
+                RecorderDirTP.s = IPS_ALERT;
+            
+            IDSetText(&RecorderDirTP, nullptr);
+            return true;
+        }
+        
+        if (strcmp(name, AlertsFileTP.name) == 0)
+        {
+            IUUpdateText(&AlertsFileTP, texts, names, n);
+            AlertsFileTP.s = IPS_OK;
+            
+            // recompile if already alerting
+            if (psctl.alertRules() && ! setAlerts(true))
+                AlertsFileTP.s = IPS_ALERT;
+            
+            IDSetText(&AlertsFileTP, nullptr);
+            return true;
+        }
+    }
+    
+    return INDI::Focuser::ISNewText(dev, name, texts, names, n);
+}
+
+//************************************************************
+bool PWRSTR::saveConfigItems(FILE *fp)
+{
+    INDI::Focuser::saveConfigItems(fp);
+    
+    IUSaveConfigSwitch(fp, &UsbRebootSP);
+    IUSaveConfigText(fp, &ArchiveFileTP);
+    IUSaveConfigSwitch(fp, &ArchiveSP);
+    IUSaveConfigSwitch(fp, &EnergySP);
+    IUSaveConfigText(fp, &MetricsListenTP);
+    IUSaveConfigSwitch(fp, &MetricsSP);
+    IUSaveConfigText(fp, &RecorderDirTP);
+    IUSaveConfigSwitch(fp, &RecorderSP);
+    IUSaveConfigText(fp, &AlertsFileTP);
+    IUSaveConfigSwitch(fp, &AlertsSP);
+    
+    return true;
+}
+
+//************************************************************
+bool PWRSTR::setArchive(bool enable)
+{
+    if ( ! enable)
+    {
+        if (psctl.isArchiving())
+            LOG_INFO("Telemetry archive closed");
+        psctl.closeArchive();
+        return true;
+    }
+    
+    if ( ! psctl.openArchive(ArchiveFileT[0].text))
+    {
+        LOGF_ERROR("Could not open telemetry archive %s", ArchiveFileT[0].text);
+        return false;
+    }
+    
+    LOGF_INFO("Archiving telemetry to %s", ArchiveFileT[0].text);
+    return true;
+}
+
+//************************************************************
+bool PWRSTR::setEnergy(bool enable)
+{
+    if ( ! enable)
+    {
+        psctl.closeEnergy();
+        return true;
+    }
+    
+    if (psctl.energyMeter())
+        return true;
+    
+    if (psctl.sharedReader())
+    {
+        LOG_INFO("Energy counters are kept by the process polling the Power*Star");
+        return true;
+    }
+    
+    if ( ! psctl.openEnergy(PS_ENERGY_FILE))
+    {
+        LOGF_ERROR("Could not open energy counters %s", PS_ENERGY_FILE);
+        return false;
+    }
+    
+    return true;
+}
+
+//************************************************************
+// Status polls something else asks for, the energy counters only add up these
+bool PWRSTR::statusPolled()
+{
+    return psctl.isArchiving() || psctl.sharedReader() || psctl.isExporting() || psctl.isRecording()
+        || psctl.alertRules();
+}
+
+//************************************************************
+// Energy on with nothing polling counts nothing, that shows as Alert
+void PWRSTR::showEnergy(bool always)
+{
+    IPState state = EnergyS[0].s != ISS_ON ? IPS_IDLE : statusPolled() ? IPS_OK : IPS_ALERT;
+    if (state == EnergySP.s && ! always)
+        return;
+    
+    EnergySP.s = state;
+    if (state == IPS_ALERT)
+        IDSetSwitch(&EnergySP, "Energy is only counted with Archive, Metrics, Fault Rec or Alerts on");
+    else
+        IDSetSwitch(&EnergySP, nullptr);
+}
+
+//************************************************************
+bool PWRSTR::setMetrics(bool enable)
+{
+    if ( ! enable)
+    {
+        if (psctl.isExporting())
+            LOG_INFO("Metrics exporter stopped");
+        psctl.closeMetrics();
+        return true;
+    }
+    
+    if ( ! psctl.openMetrics(MetricsListenT[0].text))
+    {
+        LOGF_ERROR("Could not serve metrics on %s", MetricsListenT[0].text);
+        return false;
+    }
+    
+    LOGF_INFO("Serving OpenMetrics on %s", MetricsListenT[0].text);
+    return true;
+}
+
+//************************************************************
+bool PWRSTR::setRecorder(bool enable)
+{
+    if ( ! enable)
+    {
+        if (psctl.isRecording())
+            LOG_INFO("Fault recorder stopped");
+        psctl.closeRecorder();
+        return true;
+    }
+    
+    if ( ! psctl.openRecorder(RecorderDirT[0].text))
+    {
+        LOGF_ERROR("Could not record faults to %s", RecorderDirT[0].text);
+        return false;
+    }
+    
+    LOGF_INFO("Recording faults to %s", RecorderDirT[0].text);
+    return true;
+}
+
+//************************************************************
+bool PWRSTR::setAlerts(bool enable)
+{
+    if ( ! enable)
+    {
+        if (psctl.alertRules())
+            LOG_INFO("Alert rules stopped");
+        psctl.closeRules();
+        return true;
+    }
+    
+    string error;
+    if ( ! psctl.openRules(AlertsFileT[0].text, error))
+    {
+        LOGF_ERROR("Alert rules %s: %s", AlertsFileT[0].text, error.c_str());
+        return false;
+    }
+    
+    LOGF_INFO("Evaluating %d alert rules from %s", (int)psctl.alertRules()->count(), AlertsFileT[0].text);
     return true;
 }
 
@@ -162,13 +636,69 @@ void PWRSTR::TimerHit()
     if (!isConnected())
         return;
     
-    uint32_t faultstat = psctl.getFaultStatus(curProfile.faultMask);      
+    // log fault transitions only, not every poll while one persists
+    psctl.getFaultStatus(curProfile.faultMask);
+    
+    // the watchdog recovers the USB on its own, say what it did
+    psUsbEvent usb;
+    bool usbChanged = false;
+    while (psctl.nextUsbEvent(usb))
+    {
+        if (usb.state == PS_USB_OK)
+            LOG_INFO("USB recovered");
+        else if (usb.state == PS_USB_LOST)
+            LOGF_ERROR("USB lost, retrying every %d s", PS_USB_RETRY_MS / 1000);
+        else
+            LOGF_WARN("USB not answering: %s", psUsbStates[usb.state]);
+        usbChanged = true;
+    }
+    if (usbChanged)
+    {
+        PS_USB_STATE state = psctl.usbState();
+        UsbL[0].s = state == PS_USB_OK ? IPS_OK : state == PS_USB_LOST ? IPS_ALERT : IPS_BUSY;
+        IDSetLight(&UsbLP, nullptr);
+    }
+    
+    psFaultEvent fault;
+    uint8_t bits[32];
+    while (psctl.nextFaultEvent(fault))
+    {
+        int n = psDecodeFaults(fault.raised, bits);
+        for (int i = 0; i < n; i++)
+        {
+            if (psFaults[bits[i]].severity == PS_FAULT_FATAL)
+                LOGF_ERROR("Fatal Fault: %s, restart the Power*Star", psFaults[bits[i]].message);
+            else
+                LOGF_WARN("System Fault: %s", psFaults[bits[i]].message);
+        }
         
-    if (faultstat) {
-        LOGF_ERROR("System Fault: %08x Occurred", faultstat);
-        return;
+        n = psDecodeFaults(fault.cleared, bits);
+        for (int i = 0; i < n; i++)
+            LOGF_INFO("Fault Cleared: %s", psFaults[bits[i]].message);
     }
 
+    // one command of a queued focuser operation per tick, so the poll and
+    // an abort get in between
+    PS_FOCUS_STATE focus = psctl.focusStep();
+    if (focus == PS_FOCUS_FAILED)
+    {
+        LOG_ERROR("Focuser command not taken, stopped");
+        if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY)
+        {
+            FocusRelPosNP.s = IPS_ALERT;
+            IDSetNumber(&FocusRelPosNP, nullptr);
+            FocusAbsPosNP.s = IPS_ALERT;
+        }
+    }
+    else if (focus == PS_FOCUS_DONE && psctl.focusOp() == PS_FOCUS_SYNC)
+    {
+        targetPosition = psctl.focusTarget();
+        simPosition = targetPosition;
+        LOGF_INFO("Focuser synced to %d", targetPosition);
+    }
+    else if (focus == PS_FOCUS_DONE && psctl.focusOp() == PS_FOCUS_SET_MAX)
+        LOGF_INFO("Focuser maximum set to %d", psctl.focusTarget());
+
     uint32_t currentTicks = 0;
     
     bool rc = psctl.getAbsPosition(&currentTicks);
@@ -178,6 +708,38 @@ void PWRSTR::TimerHit()
     }
 
     m_Motor = static_cast<PS_MOTOR>(psctl.getFocusStatus());
+    
+    // getStatus feeds the archive; the energy counters only add up the
+    // polls made anyway, they don't ask for one
+    if (statusPolled() || psctl.restoreDue())
+        psctl.getStatus();
+    showEnergy();
+    
+    string restored;
+    if (psctl.nextRestore(restored))
+        LOGF_INFO("Power*Star was reset, restored %s", restored.c_str());
+    
+    psAlert alert;
+    while (psctl.alertRules() && psctl.alertRules()->nextAlert(alert))
+    {
+        if (alert.raised)
+            LOGF_WARN("Alert %s: %s", alert.rule, alert.condition);
+        else
+            LOGF_INFO("Alert %s cleared", alert.rule);
+    }
+    
+    string capture;
+    if (psctl.nextCapture(capture))
+        LOGF_INFO("Fault capture written to %s", capture.c_str());
+    
+    double ah[PSE_NPORTS], wh[PSE_NPORTS];
+    uint64_t since;
+    if (EnergyS[0].s == ISS_ON && psctl.getEnergy(ah, wh, &since))
+    {
+        EnergyN[0].value = ah[PSE_IN];
+        EnergyN[1].value = wh[PSE_IN];
+        IDSetNumber(&EnergyNP, nullptr);
+    }
 
     if (FocusAbsPosNP.s == IPS_BUSY || FocusRelPosNP.s == IPS_BUSY)
     {
@@ -198,7 +760,7 @@ void PWRSTR::TimerHit()
             FocusAbsPosN[0].value = simPosition;
         }
 
-        if (m_Motor == PS_NOT_MOVING && targetPosition == FocusAbsPosN[0].value)
+        if ( ! psctl.focusBusy() && m_Motor == PS_NOT_MOVING && targetPosition == FocusAbsPosN[0].value)
         {
             if (FocusRelPosNP.s == IPS_BUSY)
             {
@@ -218,10 +780,20 @@ void PWRSTR::TimerHit()
 }
 
 //************************************************************
+// Sends the first command now, TimerHit the rest
 IPState PWRSTR::MoveAbsFocuser(uint32_t targetTicks)
 {
-    if ( ! psctl.MoveAbsFocuser(targetTicks))
+    if ( ! psctl.startFocus(PS_FOCUS_MOVE, targetTicks))
+    {
+        LOG_ERROR("Focuser still busy with the last command");
+        return IPS_ALERT;
+    }
+    
+    if (psctl.focusStep() == PS_FOCUS_FAILED)
+    {
+        LOG_ERROR("Focuser move not taken");
         return IPS_ALERT;
+    }
 
     targetPosition = targetTicks;
     FocusAbsPosNP.s = IPS_BUSY;
@@ -240,7 +812,7 @@ IPState PWRSTR::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
 
     targetAbsPosition = std::min(static_cast<uint32_t>(FocusMaxPosN[0].value),static_cast<uint32_t>(std::max(static_cast<int>(FocusAbsPosN[0].min), targetAbsPosition)));
 
-    return (IPState)psctl.MoveAbsFocuser(targetAbsPosition);
+    return MoveAbsFocuser(targetAbsPosition);
 }
 
 //************************************************************
@@ -252,20 +824,27 @@ bool PWRSTR::AbortFocuser()
 }
 
 //************************************************************
+// Queued, TimerHit sends it and says when it's done
 bool PWRSTR::SyncFocuser(uint32_t ticks)
 {
-    if ( ! psctl.setAbsPosition(ticks))
+    if ( ! psctl.startFocus(PS_FOCUS_SYNC, ticks))
+    {
+        LOG_ERROR("Focuser still busy with the last command");
         return false;
+    }
 
-    targetPosition = ticks;
-    simPosition = ticks;
-
-    return psctl.SyncFocuser(ticks);
+    return true;
 }
 
 //************************************************************
 bool PWRSTR::SetFocuserMaxPosition(uint32_t ticks)
 {
-    return psctl.SetFocuserMaxPosition(ticks);
+    if ( ! psctl.startFocus(PS_FOCUS_SET_MAX, ticks))
+    {
+        LOG_ERROR("Focuser still busy with the last command");
+        return false;
+    }
+
+    return true;
 }
 
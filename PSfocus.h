@@ -9,6 +9,13 @@
 
 #include "indifocuser.h"
 #include "PScontrol.h"
+#include "PSarchive.h"
+#include "PSenergy.h"
+#include "PSmetrics.h"
+#include "PSfaults.h"
+#include "PSrecorder.h"
+#include "PSrules.h"
+#include "PSjournal.h"
 #include "hidapi.h"
 #include <map>
 #include <cmath>
@@ -37,6 +44,10 @@ class PWRSTR : public INDI::Focuser
 
         const char *getDefaultName() override;
         virtual bool initProperties() override;
+        virtual bool updateProperties() override;
+        virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n) override;
+        virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n) override;
+        virtual bool saveConfigItems(FILE *fp) override;
 
         virtual bool Connect() override;
         virtual bool Disconnect() override;
@@ -86,5 +97,55 @@ class PWRSTR : public INDI::Focuser
         static const uint16_t PS_TIMEOUT { 1000 };
         
         PowerStarProfile curProfile;
+        
+        // Telemetry archive
+        ISwitch ArchiveS[2];
+        ISwitchVectorProperty ArchiveSP;
+        IText ArchiveFileT[1] {};
+        ITextVectorProperty ArchiveFileTP;
+        
+        bool setArchive(bool enable);
+        
+        // Energy accounting
+        ISwitch EnergyS[2];
+        ISwitchVectorProperty EnergySP;
+        ISwitch EnergyResetS[1];
+        ISwitchVectorProperty EnergyResetSP;
+        INumber EnergyN[2];
+        INumberVectorProperty EnergyNP;
+        
+        bool setEnergy(bool enable);
+        bool statusPolled();
+        void showEnergy(bool always = false);
+        
+        // OpenMetrics exporter
+        ISwitch MetricsS[2];
+        ISwitchVectorProperty MetricsSP;
+        IText MetricsListenT[1] {};
+        ITextVectorProperty MetricsListenTP;
+        
+        bool setMetrics(bool enable);
+        
+        // Fault flight recorder
+        ISwitch RecorderS[2];
+        ISwitchVectorProperty RecorderSP;
+        IText RecorderDirT[1] {};
+        ITextVectorProperty RecorderDirTP;
+        
+        bool setRecorder(bool enable);
+        
+        // USB watchdog
+        ILight UsbL[1];
+        ILightVectorProperty UsbLP;
+        ISwitch UsbRebootS[2];
+        ISwitchVectorProperty UsbRebootSP;
+        
+        // Alert rules
+        ISwitch AlertsS[2];
+        ISwitchVectorProperty AlertsSP;
+        IText AlertsFileT[1] {};
+        ITextVectorProperty AlertsFileTP;
+        
+        bool setAlerts(bool enable);
 };
 
@@ -0,0 +1,111 @@
+/***************************************************************
+*  Program:      PSjournal.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star desired-state journal
+****************************************************************/
+
+#include "PSjournal.h"
+#include "PSarchive.h"
+#include <cstdio>
+#include <cstddef>
+using namespace std;
+
+//******************************************************************
+bool PSJOURNAL::open(const char *path)
+{
+    file = path;
+
+    if (load())
+        return true;
+
+    state = psState {};
+    state.magic = PSJ_MAGIC;
+    state.version = PSJ_VERSION;
+    return save();
+}
+
+//******************************************************************
+bool PSJOURNAL::load()
+{
+    psState saved;
+    FILE *fin = fopen(file.c_str(), "r");
+    if ( ! fin)
+        return false;
+
+    bool ok = fread(&saved, sizeof(saved), 1, fin) == 1;
+    fclose(fin);
+
+    if ( ! ok || saved.magic != PSJ_MAGIC || saved.version != PSJ_VERSION
+         || saved.crc != PSARCHIVE::crc32(0, (const uint8_t *)&saved, offsetof(psState, crc)))
+        return false;
+
+    state = saved;
+    return true;
+}
+
+//******************************************************************
+// write-then-rename so a crash never leaves a half written file
+bool PSJOURNAL::save()
+{
+    state.crc = PSARCHIVE::crc32(0, (const uint8_t *)&state, offsetof(psState, crc));
+
+    string tmp = file + ".tmp";
+    FILE *fout = fopen(tmp.c_str(), "w");
+    if ( ! fout)
+        return false;
+
+    bool ok = fwrite(&state, sizeof(state), 1, fout) == 1;
+    ok = (fclose(fout) == 0) && ok;
+    if (ok)
+        ok = rename(tmp.c_str(), file.c_str()) == 0;
+    return ok;
+}
+
+//******************************************************************
+void PSJOURNAL::setPorts(uint16_t ports)
+{
+    load();
+    state.ports = ports;
+    state.known |= PSJ_PORTS;
+    save();
+}
+
+//******************************************************************
+void PSJOURNAL::setDew(uint8_t channel, uint8_t percent)
+{
+    if (channel > 1)
+        return;
+
+    load();
+    state.dew[channel] = percent;
+    state.known |= channel == 0 ? PSJ_DEW1 : PSJ_DEW2;
+    save();
+}
+
+//******************************************************************
+void PSJOURNAL::setVar(uint8_t voltage)
+{
+    load();
+    state.var = voltage;
+    state.known |= PSJ_VAR;
+    save();
+}
+
+//******************************************************************
+void PSJOURNAL::setLED(uint8_t brightness)
+{
+    load();
+    state.led = brightness;
+    state.known |= PSJ_LED;
+    save();
+}
+
+//******************************************************************
+void PSJOURNAL::setMultiPort(uint8_t mpMode)
+{
+    load();
+    state.mpMode = mpMode;
+    state.known |= PSJ_MP;
+    save();
+}
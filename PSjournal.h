@@ -0,0 +1,69 @@
+/***************************************************************
+*  Program:      PSjournal.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star desired-state journal .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <string>
+
+/*
+ * The port, dew, VAR, LED and multiport settings last asked for through
+ * PSCTL, kept in a file so they survive a Power*Star reset (and us).
+ * Only fields that were set are in known; the rest are left to the
+ * autoboot defaults.
+ *
+ * Every update re-reads the file first, so the driver and pstui share
+ * one journal.
+ */
+
+#define PS_STATE_FILE       "/etc/powerstar.state"
+
+#define PSJ_MAGIC           0x4a535350      // "PSSJ"
+#define PSJ_VERSION         1
+
+typedef enum { PSJ_PORTS = 0x01,
+               PSJ_DEW1  = 0x02,
+               PSJ_DEW2  = 0x04,
+               PSJ_VAR   = 0x08,
+               PSJ_LED   = 0x10,
+               PSJ_MP    = 0x20
+} PSJ_FIELD;
+
+#pragma pack(push, 1)
+typedef struct {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t known;                 // PSJ_FIELD bits set
+            uint16_t ports;                 // PS_PORT_CTL mask
+            uint8_t  dew[2];                // %
+            uint8_t  var;                   // setVar units
+            uint8_t  led;                   // 0-5
+            uint8_t  mpMode;                // 0:DC 1:PWM 2:Dew
+            uint32_t crc;                   // crc32 of the state to here
+} psState;
+#pragma pack(pop)
+
+class PSJOURNAL
+{
+    public:
+        bool    open(const char *path);
+        bool    load();                     // latest from the file
+
+        void    setPorts(uint16_t ports);
+        void    setDew(uint8_t channel, uint8_t percent);
+        void    setVar(uint8_t voltage);
+        void    setLED(uint8_t brightness);
+        void    setMultiPort(uint8_t mpMode);
+
+        const psState &desired() { return state; }
+
+    private:
+        bool    save();
+
+        string   file;
+        psState  state {};
+};
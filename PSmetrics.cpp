@@ -0,0 +1,391 @@
+/***************************************************************
+*  Program:      PSmetrics.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star OpenMetrics exporter
+****************************************************************/
+
+#include "PSmetrics.h"
+#include "PSports.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+using namespace std;
+
+// upper bounds of the latency buckets, seconds
+static const double latencyBuckets[PSM_BUCKETS] = {
+        0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 1.0
+        };
+
+// getFocusStatus codes
+static const char *motorStates[] = {
+        "idle", "moving_in", "moving_out", "busy", "unknown", "locked"
+        };
+
+//******************************************************************
+static void family(string &out, const char *name, const char *type, const char *unit, const char *help)
+{
+    out += "# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+    if (unit) {
+        out += "# UNIT ";
+        out += name;
+        out += " ";
+        out += unit;
+        out += "\n";
+    }
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n";
+}
+
+//******************************************************************
+static void metric(string &out, const char *name, const char *labels, double value)
+{
+    char line[200];
+    if (labels && *labels)
+        snprintf(line, sizeof(line), "%s{%s} %.9g\n", name, labels, value);
+    else
+        snprintf(line, sizeof(line), "%s %.9g\n", name, value);
+    out += line;
+}
+
+//******************************************************************
+PSMETRICS::~PSMETRICS()
+{
+    stop();
+}
+
+//******************************************************************
+bool PSMETRICS::start(const char *listen)
+{
+    stop();
+
+    string where = listen;
+    if (where.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        unixPath = where.substr(5);
+        if (unixPath.empty() || unixPath.size() >= sizeof(addr.sun_path))
+            return false;
+        strcpy(addr.sun_path, unixPath.c_str());
+
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0)
+            return false;
+        unlink(unixPath.c_str());
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            sock = -1;
+            return false;
+        }
+        chmod(unixPath.c_str(), 0666);
+    }
+    else {
+        // "port" binds localhost, "host:port" anything else
+        string host = "127.0.0.1";
+        size_t colon = where.rfind(':');
+        if (colon != string::npos) {
+            host = where.substr(0, colon);
+            where = where.substr(colon + 1);
+        }
+
+        struct sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(where.c_str()));
+        if (addr.sin_port == 0 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+            return false;
+
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0)
+            return false;
+        int on = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            sock = -1;
+            return false;
+        }
+    }
+
+    if (::listen(sock, 4) < 0) {
+        stop();
+        return false;
+    }
+
+    running = true;
+    server = std::thread(&PSMETRICS::serve, this);
+    return true;
+}
+
+//******************************************************************
+void PSMETRICS::stop()
+{
+    running = false;
+    if (server.joinable())
+        server.join();
+
+    if (sock >= 0)
+        close(sock);
+    sock = -1;
+
+    if ( ! unixPath.empty())
+        unlink(unixPath.c_str());
+    unixPath.clear();
+}
+
+//******************************************************************
+void PSMETRICS::setStatus(const psSample &sample)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    status = sample;
+}
+
+//******************************************************************
+void PSMETRICS::setFaults(uint32_t word)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    faults = word;
+    haveFaults = true;
+}
+
+//******************************************************************
+void PSMETRICS::setPosition(uint32_t ticks)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    position = ticks;
+    havePosition = true;
+}
+
+//******************************************************************
+void PSMETRICS::setMotor(uint8_t state)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    motor = state;
+    haveMotor = true;
+}
+
+//******************************************************************
+void PSMETRICS::command(uint8_t opcode, double seconds, bool ok)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    cmdStats &cmd = cmds[opcode];
+
+    cmd.count++;
+    cmd.seconds += seconds;
+    if ( ! ok)
+        cmd.errors++;
+    for (int b = 0; b < PSM_BUCKETS; b++)
+        if (seconds <= latencyBuckets[b])
+            cmd.bucket[b]++;
+}
+
+//******************************************************************
+string PSMETRICS::render()
+{
+    // copy out, format without holding up the poller
+    lock.lock();
+    psSample s = status;
+    uint32_t f = faults;
+    bool     haveF = haveFaults;
+    uint32_t pos = position;
+    bool     haveP = havePosition;
+    uint8_t  mtr = motor;
+    bool     haveM = haveMotor;
+    cmdStats c[256];
+    memcpy(c, cmds, sizeof(c));
+    lock.unlock();
+
+    string out;
+    out.reserve(16384);
+    char labels[80];
+
+    if (s.time) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        double now = ts.tv_sec + ts.tv_nsec / 1e9;
+
+        family(out, "powerstar_status_age_seconds", "gauge", "seconds", "Time since the last status poll.");
+        metric(out, "powerstar_status_age_seconds", nullptr, now - s.time / 1000.0);
+
+        uint16_t on = s.value[PS_CH_PORTS];
+        family(out, "powerstar_port_on", "gauge", nullptr, "Port or USB power switched on.");
+        for (const psPort &p : psPorts) {
+            if (p.mask == 0)
+                continue;           // dew ports follow their setting
+            snprintf(labels, sizeof(labels), "port=\"%s\"", p.name);
+            metric(out, "powerstar_port_on", labels, (on & p.mask) != 0);
+        }
+
+        uint16_t boot = s.value[PS_CH_AUTOBOOT];
+        family(out, "powerstar_autoboot", "gauge", nullptr, "Port powered on at boot.");
+        for (const psPort &p : psPorts) {
+            if (p.autoboot == 0)
+                continue;
+            snprintf(labels, sizeof(labels), "port=\"%s\"", p.name);
+            metric(out, "powerstar_autoboot", labels, (boot & p.autoboot) != 0);
+        }
+
+        family(out, "powerstar_voltage_volts", "gauge", "volts", "Supply, variable and internal rail voltage.");
+        metric(out, "powerstar_voltage_volts", "rail=\"IN\"", s.value[PS_CH_IN_V]);
+        metric(out, "powerstar_voltage_volts", "rail=\"Var\"", s.value[PS_CH_VAR_V]);
+        metric(out, "powerstar_voltage_volts", "rail=\"Int\"", s.value[PS_CH_INT_V]);
+
+        family(out, "powerstar_current_amperes", "gauge", "amperes", "Port current, IN is the total drawn.");
+        for (const psPort &p : psPorts) {
+            if (p.amps < 0)
+                continue;
+            snprintf(labels, sizeof(labels), "port=\"%s\"", p.name);
+            metric(out, "powerstar_current_amperes", labels, s.value[p.amps]);
+        }
+
+        family(out, "powerstar_dew_percent", "gauge", nullptr, "Dew heater duty cycle.");
+        metric(out, "powerstar_dew_percent", "port=\"Dew1\"", s.value[PS_CH_DEW1_SET]);
+        metric(out, "powerstar_dew_percent", "port=\"Dew2\"", s.value[PS_CH_DEW2_SET]);
+
+        family(out, "powerstar_var_setpoint_volts", "gauge", "volts", "Variable port voltage setting.");
+        metric(out, "powerstar_var_setpoint_volts", nullptr, s.value[PS_CH_VAR_SET]);
+
+        family(out, "powerstar_temperature_celsius", "gauge", "celsius", "Environment sensor temperature.");
+        metric(out, "powerstar_temperature_celsius", nullptr, (s.value[PS_CH_TEMP] - 32) * 5 / 9.0);
+
+        family(out, "powerstar_humidity_percent", "gauge", nullptr, "Environment sensor relative humidity.");
+        metric(out, "powerstar_humidity_percent", nullptr, s.value[PS_CH_HUM]);
+
+        family(out, "powerstar_multiport_mode", "gauge", nullptr, "Multiport mode, 0=DC 1=PWM 2=Dew.");
+        metric(out, "powerstar_multiport_mode", nullptr, s.value[PS_CH_MP_MODE]);
+
+        family(out, "powerstar_led_level", "gauge", nullptr, "LED brightness, 0=off.");
+        metric(out, "powerstar_led_level", nullptr, s.value[PS_CH_LED]);
+
+        family(out, "powerstar_motor_type", "gauge", nullptr, "Focus motor type, 0=unipolar 1=bipolar.");
+        metric(out, "powerstar_motor_type", nullptr, s.value[PS_CH_FM]);
+    }
+
+    if (haveF) {
+        // low half level 1 (non fatal), high half level 2 (fatal)
+        family(out, "powerstar_fault", "gauge", nullptr, "Fault bit set, by level, bit and port.");
+        for (int bit = 0; bit < 32; bit++) {
+            if (psFaults[bit].message == nullptr)
+                continue;
+            snprintf(labels, sizeof(labels), "level=\"%d\",bit=\"%d\",port=\"%s\"",
+                     psFaults[bit].severity, bit % 16, psFaults[bit].port);
+            metric(out, "powerstar_fault", labels, (f >> bit) & 1);
+        }
+    }
+
+    if (haveP) {
+        family(out, "powerstar_focuser_position_steps", "gauge", "steps", "Focuser absolute position.");
+        metric(out, "powerstar_focuser_position_steps", nullptr, pos);
+    }
+
+    if (haveM) {
+        family(out, "powerstar_focuser_state", "stateset", nullptr, "Focus motor state.");
+        for (unsigned m = 0; m < sizeof(motorStates) / sizeof(motorStates[0]); m++) {
+            snprintf(labels, sizeof(labels), "powerstar_focuser_state=\"%s\"", motorStates[m]);
+            metric(out, "powerstar_focuser_state", labels, mtr == m);
+        }
+    }
+
+    family(out, "powerstar_command_latency_seconds", "histogram", "seconds", "USB command round trip, by opcode.");
+    for (int op = 0; op < 256; op++) {
+        if (c[op].count == 0)
+            continue;
+        for (int b = 0; b < PSM_BUCKETS; b++) {
+            snprintf(labels, sizeof(labels), "opcode=\"0x%02x\",le=\"%g\"", op, latencyBuckets[b]);
+            metric(out, "powerstar_command_latency_seconds_bucket", labels, c[op].bucket[b]);
+        }
+        snprintf(labels, sizeof(labels), "opcode=\"0x%02x\",le=\"+Inf\"", op);
+        metric(out, "powerstar_command_latency_seconds_bucket", labels, c[op].count);
+        snprintf(labels, sizeof(labels), "opcode=\"0x%02x\"", op);
+        metric(out, "powerstar_command_latency_seconds_count", labels, c[op].count);
+        metric(out, "powerstar_command_latency_seconds_sum", labels, c[op].seconds);
+    }
+
+    family(out, "powerstar_command_errors", "counter", nullptr, "USB commands that failed to open, write or read.");
+    for (int op = 0; op < 256; op++) {
+        if (c[op].count == 0)
+            continue;
+        snprintf(labels, sizeof(labels), "opcode=\"0x%02x\"", op);
+        metric(out, "powerstar_command_errors_total", labels, c[op].errors);
+    }
+
+    out += "# EOF\n";
+    return out;
+}
+
+//******************************************************************
+// Accept loop, polls so stop() is seen within half a second
+void PSMETRICS::serve()
+{
+    while (running) {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+
+        int client = accept(sock, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        struct timeval tv = { 1, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        reply(client);
+        close(client);
+    }
+}
+
+//******************************************************************
+void PSMETRICS::reply(int client)
+{
+    char request[2048];
+    size_t got = 0;
+
+    // only the request line matters, read to the end of the headers
+    while (got < sizeof(request) - 1) {
+        ssize_t n = recv(client, request + got, sizeof(request) - 1 - got, 0);
+        if (n <= 0)
+            break;
+        got += n;
+        request[got] = 0;
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+            break;
+    }
+    request[got] = 0;
+
+    string body, head;
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        body = render();
+        head = "HTTP/1.0 200 OK\r\n"
+               "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n";
+    }
+    else {
+        body = "Not found, try /metrics\n";
+        head = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n";
+    }
+    head += "Content-Length: " + to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+
+    string response = head + body;
+    const char *p = response.data();
+    size_t left = response.size();
+    while (left > 0) {
+        ssize_t n = send(client, p, left, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        p += n;
+        left -= n;
+    }
+}
@@ -0,0 +1,74 @@
+/***************************************************************
+*  Program:      PSmetrics.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star OpenMetrics exporter .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+ * Serves the latest status snapshot, fault word, focuser state and the
+ * PSCTL command counters in OpenMetrics text format over HTTP.
+ *
+ * The poller (getStatus, getFaultStatus, hidCMD ...) only copies values
+ * into the snapshot under a mutex; the exporter thread renders a scrape
+ * from that copy, so a scrape never touches the USB.
+ *
+ * listen: "port", "host:port" or "unix:/path/to/socket"
+ */
+
+#define PS_METRICS_LISTEN   "127.0.0.1:9163"
+
+#define PSM_BUCKETS         11              // latency histogram buckets, plus +Inf
+
+class PSMETRICS
+{
+    public:
+        ~PSMETRICS();
+
+        bool    start(const char *listen);
+        void    stop();
+
+        // poller side
+        void    setStatus(const psSample &sample);
+        void    setFaults(uint32_t faults);
+        void    setPosition(uint32_t position);
+        void    setMotor(uint8_t state);
+        void    command(uint8_t opcode, double seconds, bool ok);
+
+        // a full OpenMetrics exposition of the snapshot
+        string  render();
+
+    private:
+        void    serve();
+        void    reply(int client);
+
+        typedef struct {
+            uint64_t count;
+            uint64_t errors;
+            double   seconds;
+            uint64_t bucket[PSM_BUCKETS];
+        } cmdStats;
+
+        std::mutex  lock;
+        psSample    status {};
+        uint32_t    faults { 0 };
+        bool        haveFaults { false };
+        uint32_t    position { 0 };
+        bool        havePosition { false };
+        uint8_t     motor { 0 };
+        bool        haveMotor { false };
+        cmdStats    cmds[256] {};
+
+        std::thread       server;
+        std::atomic<bool> running { false };
+        int               sock { -1 };
+        string            unixPath;
+};
@@ -0,0 +1,110 @@
+/***************************************************************
+*  Program:      PSports.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star port table
+****************************************************************/
+
+#pragma once
+
+#include "PSenergy.h"
+#include "PSfaults.h"
+#include <strings.h>
+
+/*
+ * Everything about each port, one row each.  The first rows are in
+ * PSE_PORT order (psPorts[PSE_DEW1] is Dew1), then Int and the USBs.
+ *
+ *   mask       its PS_PORT_CTL / PS_PORT_STATUS bit, 0: not switched
+ *              that way (the dew heaters go by percent)
+ *   autoboot   its PS_SET_AUTO / PS_GET_AUTO bit
+ *   fixed      always on, the bit reads but doesn't switch
+ *   amps       PS_CH_ channel of its current, ampScale PS_CURRENT
+ *              counts to A (dew: full on)
+ *   ampLimit   user limit number (PS_GET_ULIMIT) of its current
+ *   volts      PS_VOLTS channel, voltScale counts to V
+ *   voltLimit  user limit numbers of its low and (+1) high volts
+ *   faults     its getFaultStatus bits, from psFaults
+ *
+ * User limits read as counts * scale and are written as value / scale
+ * / step (PS_VOLT_LIMIT_STEP for volts).  -1 is none for all the
+ * channels and limits.
+ */
+
+typedef enum { PSP_INT = PSE_NPORTS,
+               PSP_USB1,
+               PSP_USB2,
+               PSP_USB3,
+               PSP_USB4,
+               PSP_USB5,
+               PSP_USB6,
+               PSP_NPORTS
+} PSP_PORT;
+
+#define PS_PORTS_ALL        0xfffe      // "all", Out1 left alone
+#define PS_VOLT_LIMIT_STEP  4
+#define PS_USER_LIMITS      12
+
+typedef struct {
+            const char *name;
+            uint16_t mask;
+            uint16_t autoboot;
+            bool     fixed;
+            int8_t   amps;
+            float    ampScale;
+            int8_t   ampLimit;
+            double   ampLimitScale;
+            uint8_t  ampLimitStep;
+            int8_t   volts;
+            float    voltScale;
+            int8_t   voltLimit;
+            double   voltLimitScale;
+            uint32_t faults;
+} psPort;
+
+constexpr bool psSameName(const char *a, const char *b)
+{
+    return *a == *b && (*a == 0 || psSameName(a + 1, b + 1));
+}
+
+// All fault bits, either level, that belong to port (a psFaults port name)
+constexpr uint32_t psPortFaults(const char *port, int bit = 0)
+{
+    return bit == 32 ? 0
+         : ((psFaults[bit].port && psSameName(psFaults[bit].port, port)) ? 1u << bit : 0) | psPortFaults(port, bit + 1);
+}
+
+constexpr psPort psPorts[PSP_NPORTS] = {
+        // name    mask    boot    fixed  amps          ampScale  limit limitScale    step volts voltScale limit limitScale faults
+        { "Out1", 0x0001, 0x0001, false, PS_CH_OUT1_A, 0.075690, 5,  1 / 13.21179, 1, -1, 0,        -1, 0,        psPortFaults("Out1") },
+        { "Out2", 0x0002, 0x0002, false, PS_CH_OUT2_A, 0.075690, 6,  1 / 13.21179, 1, -1, 0,        -1, 0,        psPortFaults("Out2") },
+        { "Out3", 0x0004, 0x0004, false, PS_CH_OUT3_A, 0.010111, 7,  1 / 98.9,     4, -1, 0,        -1, 0,        psPortFaults("Out3") },
+        { "Out4", 0x0008, 0x0008, false, PS_CH_OUT4_A, 0.010111, 8,  1 / 98.9,     4, -1, 0,        -1, 0,        psPortFaults("Out4") },
+        { "Dew1", 0,      0x0010, false, PS_CH_DEW1_A, 0.010111, 9,  1 / 98.9,     4, -1, 0,        -1, 0,        psPortFaults("Dew1") },
+        { "Dew2", 0,      0x0020, false, PS_CH_DEW2_A, 0.010111, 10, 1 / 98.9,     4, -1, 0,        -1, 0,        psPortFaults("Dew2") },
+        { "Var",  0x0040, 0x0040, false, PS_CH_VAR_A,  0.010111, -1, 0,            0, 1,  0.012813, 2,  .0128128, psPortFaults("Var") },
+        { "MP",   0x0080, 0x0080, false, PS_CH_MP_A,   0.010111, 11, 1 / 98.9,     4, -1, 0,        -1, 0,        psPortFaults("MP") },
+        { "IN",   0,      0,      false, PS_CH_IN_A,   0.001780, 4,  1 / 11.23876, 1, 0,  0.014695, 0,  .014595,  psPortFaults("IN") },
+        { "Int",  0,      0,      false, -1,           0,        -1, 0,            0, 2,  0.004004, -1, 0,        psPortFaults("Int") },
+        { "USB1", 0x0100, 0x0100, true,  -1,           0,        -1, 0,            0, -1, 0,        -1, 0,        0 },
+        { "USB2", 0x0200, 0x0200, false, -1,           0,        -1, 0,            0, -1, 0,        -1, 0,        0 },
+        { "USB3", 0x0400, 0x0400, false, -1,           0,        -1, 0,            0, -1, 0,        -1, 0,        0 },
+        { "USB4", 0x0800, 0x0800, true,  -1,           0,        -1, 0,            0, -1, 0,        -1, 0,        0 },
+        { "USB5", 0x1000, 0x1000, true,  -1,           0,        -1, 0,            0, -1, 0,        -1, 0,        0 },
+        { "USB6", 0x2000, 0x2000, false, -1,           0,        -1, 0,            0, -1, 0,        -1, 0,        0 }
+        };
+
+// Scale of a PS_VOLTS channel, from the row that has it
+constexpr float psVoltScale(int8_t channel, int p = 0)
+{
+    return p == PSP_NPORTS ? 0 : psPorts[p].volts == channel ? psPorts[p].voltScale : psVoltScale(channel, p + 1);
+}
+
+// Row of a port name, any case; -1 if there isn't one
+inline int psPortIndex(const char *name)
+{
+    for (int p = 0; p < PSP_NPORTS; p++)
+        if (strcasecmp(name, psPorts[p].name) == 0)
+            return p;
+    return -1;
+}
@@ -0,0 +1,536 @@
+/***************************************************************
+*  Program:      PSquery.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Range queries over the Power*Star telemetry archive
+****************************************************************/
+
+#include "PSarchive.h"
+#include "PSshm.h"
+#include "PSrecorder.h"
+#include "PSfaults.h"
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+using namespace std;
+
+static const char *archiveFile = PS_ARCHIVE_FILE;
+static uint64_t fromMs = 0;
+static uint64_t toMs = UINT64_MAX;
+
+static vector<uint64_t> tbuf(PSA_BLOCK_SAMPLES);
+static vector<float>    vbuf(PSA_BLOCK_SAMPLES);
+
+//************************************************************
+static void usage()
+{
+    printf("Usage: psquery [-f file] [-s start] [-e end] command ...\n\n");
+    printf("  list                             channel names\n");
+    printf("  info                             blocks, samples and time span\n");
+    printf("  stats [-p 50,90,99] chan ...     min max mean (and percentiles)\n");
+    printf("  export [-i secs] chan ...        CSV, optionally averaged per interval\n");
+    printf("  where chan op value [chan ...]   samples where chan op value (op: > >= < <= == !=)\n");
+    printf("  live [-n count] [chan ...]       CSV of the last polls shared by the running driver/pstui\n");
+    printf("  capture                          fault summary of a fault recorder file (-f)\n\n");
+    printf("start/end: epoch seconds, YYYY-MM-DD[THH:MM[:SS]] local time, or -30m, -2h, -7d\n");
+    printf("default file: %s\n", PS_ARCHIVE_FILE);
+}
+
+//************************************************************
+static bool parseTime(const char *arg, uint64_t *ms)
+{
+    char *end;
+
+    // relative to now
+    if (arg[0] == '-') {
+        double amt = strtod(arg + 1, &end);
+        double mult = 1;
+        if (*end == 'm') mult = 60;
+        else if (*end == 'h') mult = 3600;
+        else if (*end == 'd') mult = 86400;
+        else if (*end != 's' && *end != '\0') return false;
+        *ms = (uint64_t)time(nullptr) * 1000 - (uint64_t)(amt * mult * 1000);
+        return true;
+    }
+
+    double secs = strtod(arg, &end);
+    if (*end == '\0') {
+        *ms = (uint64_t)(secs * 1000);
+        return true;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *rest = strptime(arg, "%Y-%m-%d", &tm);
+    if (rest == nullptr)
+        return false;
+    if (*rest == 'T' || *rest == ' ') {
+        const char *sec = strptime(rest + 1, "%H:%M:%S", &tm);
+        rest = sec ? sec : strptime(rest + 1, "%H:%M", &tm);
+        if (rest == nullptr)
+            return false;
+    }
+    tm.tm_isdst = -1;
+    *ms = (uint64_t)mktime(&tm) * 1000;
+    return true;
+}
+
+//************************************************************
+static void printTime(uint64_t ms)
+{
+    time_t secs = ms / 1000;
+    struct tm tm;
+    char buf[32];
+    localtime_r(&secs, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf("%s.%03u", buf, (unsigned)(ms % 1000));
+}
+
+//************************************************************
+static int findChannel(const char *name)
+{
+    for (int c = 0; c < PS_NCHAN; c++)
+        if (strcasecmp(name, psChannels[c].name) == 0)
+            return c;
+
+    fprintf(stderr, "Unknown channel: %s (see psquery list)\n", name);
+    exit(1);
+}
+
+//************************************************************
+static bool inWindow(const psaBlock &block)
+{
+    return block.trailer->t1 >= fromMs && block.trailer->t0 <= toMs;
+}
+
+//************************************************************
+static bool insideWindow(const psaBlock &block)
+{
+    return block.trailer->t0 >= fromMs && block.trailer->t1 <= toMs;
+}
+
+//************************************************************
+static void decodeTimes(const psaBlock &block)
+{
+    tbuf.resize(max<size_t>(tbuf.size(), block.header->count));
+    if ( ! PSAREADER::times(block, tbuf.data()))
+        fprintf(stderr, "Damaged timestamp column skipped\n");
+}
+
+//************************************************************
+static bool decodeColumn(const psaBlock &block, int channel)
+{
+    vbuf.resize(max<size_t>(vbuf.size(), block.header->count));
+    return PSAREADER::column(block, channel, vbuf.data());
+}
+
+//************************************************************
+static int cmdInfo(PSAREADER &reader)
+{
+    psaBlock block;
+    uint64_t blocks = 0, samples = 0, first = 0, last = 0;
+
+    while (reader.next(block)) {
+        if ( ! inWindow(block))
+            continue;
+        if (blocks++ == 0)
+            first = block.trailer->t0;
+        last = block.trailer->t1;
+        samples += block.header->count;
+    }
+
+    printf("blocks:  %llu\nsamples: %llu\n", (unsigned long long)blocks, (unsigned long long)samples);
+    if (blocks) {
+        printf("from:    "); printTime(first); printf("\n");
+        printf("to:      "); printTime(last); printf("\n");
+    }
+    return 0;
+}
+
+//************************************************************
+// Whole blocks inside the window are answered from the trailer summary,
+// only edge blocks and percentiles need the column decoded
+static int cmdStats(PSAREADER &reader, int argc, char *argv[])
+{
+    vector<double> pct;
+    int arg = 0;
+
+    if (arg < argc && strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+        char *tok = strtok(argv[arg + 1], ",");
+        while (tok) {
+            pct.push_back(atof(tok));
+            tok = strtok(nullptr, ",");
+        }
+        arg += 2;
+    }
+
+    if (arg >= argc) {
+        usage();
+        return 1;
+    }
+
+    printf("%-14s %10s %10s %10s %10s", "channel", "count", "min", "max", "mean");
+    for (double p : pct) {
+        char label[16];
+        snprintf(label, sizeof(label), "p%g", p);
+        printf(" %10s", label);
+    }
+    printf("\n");
+
+    for (; arg < argc; arg++) {
+        int c = findChannel(argv[arg]);
+        psaBlock block;
+        uint64_t n = 0;
+        double sum = 0;
+        float lo = INFINITY, hi = -INFINITY;
+        vector<float> all;
+
+        reader.rewind();
+        while (reader.next(block)) {
+            if ( ! inWindow(block))
+                continue;
+
+            uint32_t count = block.header->count;
+            if (insideWindow(block) && pct.empty()) {
+                n += count;
+                sum += block.trailer->sum[c];
+                lo = min(lo, block.trailer->min[c]);
+                hi = max(hi, block.trailer->max[c]);
+                continue;
+            }
+
+            if ( ! decodeColumn(block, c))
+                continue;
+
+            bool edge = ! insideWindow(block);
+            if (edge)
+                decodeTimes(block);
+
+            for (uint32_t i = 0; i < count; i++) {
+                if (edge && (tbuf[i] < fromMs || tbuf[i] > toMs))
+                    continue;
+                float v = vbuf[i];
+                n++;
+                sum += v;
+                lo = min(lo, v);
+                hi = max(hi, v);
+                if ( ! pct.empty())
+                    all.push_back(v);
+            }
+        }
+
+        if (n == 0) {
+            printf("%-14s %10s\n", psChannels[c].name, "0");
+            continue;
+        }
+
+        printf("%-14s %10llu %10.3f %10.3f %10.3f", psChannels[c].name, (unsigned long long)n, lo, hi, sum / n);
+        for (double p : pct) {
+            size_t k = min(all.size() - 1, (size_t)(p / 100.0 * (all.size() - 1) + 0.5));
+            nth_element(all.begin(), all.begin() + k, all.end());
+            printf(" %10.3f", all[k]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+//************************************************************
+static int cmdExport(PSAREADER &reader, int argc, char *argv[])
+{
+    uint64_t interval = 0;
+    int arg = 0;
+
+    if (arg < argc && strcmp(argv[arg], "-i") == 0 && arg + 1 < argc) {
+        interval = (uint64_t)(atof(argv[arg + 1]) * 1000);
+        arg += 2;
+    }
+
+    vector<int> chans;
+    for (; arg < argc; arg++)
+        chans.push_back(findChannel(argv[arg]));
+    if (chans.empty())
+        for (int c = 0; c < PS_NCHAN; c++)
+            chans.push_back(c);
+
+    printf("time");
+    for (int c : chans)
+        printf(",%s", psChannels[c].name);
+    printf("\n");
+
+    vector<vector<float>> cols(chans.size());
+    vector<double> acc(chans.size(), 0);
+    uint64_t bucket = 0, inBucket = 0;
+    psaBlock block;
+
+    while (reader.next(block)) {
+        if ( ! inWindow(block))
+            continue;
+
+        uint32_t count = block.header->count;
+        decodeTimes(block);
+        for (size_t k = 0; k < chans.size(); k++) {
+            cols[k].resize(count);
+            if ( ! PSAREADER::column(block, chans[k], cols[k].data()))
+                fill(cols[k].begin(), cols[k].end(), NAN);
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t t = tbuf[i];
+            if (t < fromMs || t > toMs)
+                continue;
+
+            if (interval == 0) {
+                printTime(t);
+                for (size_t k = 0; k < chans.size(); k++)
+                    printf(",%g", cols[k][i]);
+                printf("\n");
+                continue;
+            }
+
+            // mean per interval, buckets aligned to the epoch
+            uint64_t b = t - t % interval;
+            if (inBucket && b != bucket) {
+                printTime(bucket);
+                for (size_t k = 0; k < chans.size(); k++)
+                    printf(",%g", acc[k] / inBucket);
+                printf("\n");
+                fill(acc.begin(), acc.end(), 0);
+                inBucket = 0;
+            }
+            bucket = b;
+            inBucket++;
+            for (size_t k = 0; k < chans.size(); k++)
+                acc[k] += cols[k][i];
+        }
+    }
+
+    if (inBucket) {
+        printTime(bucket);
+        for (size_t k = 0; k < chans.size(); k++)
+            printf(",%g", acc[k] / inBucket);
+        printf("\n");
+    }
+    return 0;
+}
+
+//************************************************************
+static int cmdWhere(PSAREADER &reader, int argc, char *argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    int c = findChannel(argv[0]);
+    string op = argv[1];
+    float x = atof(argv[2]);
+
+    if (op != ">" && op != ">=" && op != "<" && op != "<=" && op != "==" && op != "!=") {
+        fprintf(stderr, "Unknown operator: %s\n", op.c_str());
+        return 1;
+    }
+
+    vector<int> extra;
+    for (int arg = 3; arg < argc; arg++)
+        extra.push_back(findChannel(argv[arg]));
+
+    printf("time,%s", psChannels[c].name);
+    for (int e : extra)
+        printf(",%s", psChannels[e].name);
+    printf("\n");
+
+    vector<vector<float>> cols(extra.size());
+    psaBlock block;
+    uint64_t hits = 0;
+
+    while (reader.next(block)) {
+        if ( ! inWindow(block))
+            continue;
+
+        // the block summary rules out whole blocks
+        float lo = block.trailer->min[c];
+        float hi = block.trailer->max[c];
+        if ((op == ">"  && hi <= x) || (op == ">=" && hi < x) ||
+            (op == "<"  && lo >= x) || (op == "<=" && lo > x) ||
+            (op == "==" && (x < lo || x > hi)) || (op == "!=" && lo == x && hi == x))
+            continue;
+
+        uint32_t count = block.header->count;
+        if ( ! decodeColumn(block, c))
+            continue;
+        decodeTimes(block);
+        bool loaded = false;
+
+        for (uint32_t i = 0; i < count; i++) {
+            float v = vbuf[i];
+            bool match = (op == ">" && v > x) || (op == ">=" && v >= x) ||
+                         (op == "<" && v < x) || (op == "<=" && v <= x) ||
+                         (op == "==" && v == x) || (op == "!=" && v != x);
+            if ( ! match || tbuf[i] < fromMs || tbuf[i] > toMs)
+                continue;
+
+            if ( ! loaded) {
+                for (size_t k = 0; k < extra.size(); k++) {
+                    cols[k].resize(count);
+                    if ( ! PSAREADER::column(block, extra[k], cols[k].data()))
+                        fill(cols[k].begin(), cols[k].end(), NAN);
+                }
+                loaded = true;
+            }
+
+            hits++;
+            printTime(tbuf[i]);
+            printf(",%g", v);
+            for (size_t k = 0; k < extra.size(); k++)
+                printf(",%g", cols[k][i]);
+            printf("\n");
+        }
+    }
+
+    fprintf(stderr, "%llu matching samples\n", (unsigned long long)hits);
+    return 0;
+}
+
+//************************************************************
+// Straight from the shared segment, the archive is not opened
+static int cmdLive(int argc, char *argv[])
+{
+    uint32_t count = 1;
+    int arg = 0;
+
+    if (arg < argc && strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+        count = max(1, atoi(argv[arg + 1]));
+        arg += 2;
+    }
+
+    vector<int> chans;
+    for (; arg < argc; arg++)
+        chans.push_back(findChannel(argv[arg]));
+    if (chans.empty())
+        for (int c = 0; c < PS_NCHAN; c++)
+            chans.push_back(c);
+
+    PSSHARED shared;
+    if ( ! shared.attach()) {
+        fprintf(stderr, "No live Power*Star status (is the driver or pstui running?)\n");
+        return 1;
+    }
+
+    vector<psSample> samples(min<uint32_t>(count, PSS_HISTORY));
+    samples.resize(shared.history(samples.data(), samples.size()));
+
+    printf("time");
+    for (int c : chans)
+        printf(",%s", psChannels[c].name);
+    printf("\n");
+
+    for (const psSample &sample : samples) {
+        printTime(sample.time);
+        for (int c : chans)
+            printf(",%g", sample.value[c]);
+        printf("\n");
+    }
+    return 0;
+}
+
+//************************************************************
+static int cmdCapture()
+{
+    psrSummary summary;
+    if ( ! PSRECORDER::readSummary(archiveFile, summary)) {
+        fprintf(stderr, "%s is not a fault capture\n", archiveFile);
+        return 1;
+    }
+
+    printf("trigger  ");
+    printTime(summary.trigger);
+    printf("\nsamples  %u before, %u after\n\n", summary.pre, summary.post);
+
+    uint8_t bits[32];
+    for (int e = 0; e < summary.events; e++) {
+        const psFaultEvent &event = summary.event[e];
+        int n = psDecodeFaults(event.raised, bits);
+        for (int i = 0; i < n; i++) {
+            printTime(event.time);
+            printf("  raised   %s%s\n", psFaults[bits[i]].severity == PS_FAULT_FATAL ? "Fatal: " : "", psFaults[bits[i]].message);
+        }
+        n = psDecodeFaults(event.cleared, bits);
+        for (int i = 0; i < n; i++) {
+            printTime(event.time);
+            printf("  cleared  %s\n", psFaults[bits[i]].message);
+        }
+    }
+    return 0;
+}
+
+//************************************************************
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "+f:s:e:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                archiveFile = optarg;
+                break;
+            case 's':
+                if ( ! parseTime(optarg, &fromMs)) {
+                    fprintf(stderr, "Bad start time: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e':
+                if ( ! parseTime(optarg, &toMs)) {
+                    fprintf(stderr, "Bad end time: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
+
+    string cmd = argv[optind++];
+    if (cmd == "list") {
+        for (int c = 0; c < PS_NCHAN; c++)
+            printf("%-14s %s\n", psChannels[c].name, psChannels[c].unit);
+        return 0;
+    }
+    if (cmd == "live")
+        return cmdLive(argc - optind, argv + optind);
+    if (cmd == "capture")
+        return cmdCapture();
+
+    PSAREADER reader;
+    if ( ! reader.open(archiveFile)) {
+        fprintf(stderr, "Could not open archive %s\n", archiveFile);
+        return 1;
+    }
+
+    int rest = argc - optind;
+    char **args = argv + optind;
+
+    if (cmd == "info")
+        return cmdInfo(reader);
+    if (cmd == "stats")
+        return cmdStats(reader, rest, args);
+    if (cmd == "export")
+        return cmdExport(reader, rest, args);
+    if (cmd == "where")
+        return cmdWhere(reader, rest, args);
+
+    usage();
+    return 1;
+}
@@ -0,0 +1,152 @@
+/***************************************************************
+*  Program:      PSrecorder.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star fault flight recorder
+****************************************************************/
+
+#include "PSrecorder.h"
+#include "PSarchive.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+using namespace std;
+
+//******************************************************************
+bool PSRECORDER::open(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0 || ! S_ISDIR(st.st_mode) || access(path, W_OK) < 0)
+        return false;
+
+    dir = path;
+    head = filled = posted = 0;
+    triggered = false;
+    return true;
+}
+
+//******************************************************************
+// Don't lose a capture that is still collecting its post window
+void PSRECORDER::close()
+{
+    if (triggered)
+        write();
+    triggered = false;
+}
+
+//******************************************************************
+void PSRECORDER::record(const psSample &sample)
+{
+    if ( ! triggered) {
+        pre[head] = sample;
+        head = (head + 1) % PSR_PRE_SAMPLES;
+        if (filled < PSR_PRE_SAMPLES)
+            filled++;
+        return;
+    }
+
+    post[posted++] = sample;
+    if (posted == PSR_POST_SAMPLES)
+        write();
+}
+
+//******************************************************************
+// A raised fault freezes the ring, later edges join the same capture
+void PSRECORDER::trigger(const psFaultEvent &event)
+{
+    if ( ! triggered && event.raised == 0)
+        return;
+
+    if ( ! triggered) {
+        memset(&summary, 0, sizeof(summary));
+        summary.magic = PSR_MAGIC;
+        summary.version = PSR_VERSION;
+        summary.trigger = event.time;
+        posted = 0;
+        triggered = true;
+    }
+
+    if (summary.events < PSR_MAX_EVENTS)
+        summary.event[summary.events++] = event;
+}
+
+//******************************************************************
+bool PSRECORDER::write()
+{
+    triggered = false;
+
+    time_t secs = summary.trigger / 1000;
+    struct tm tm;
+    char stamp[32];
+    localtime_r(&secs, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    string path = dir + "/" PS_RECORDER_PREFIX + stamp + ".psf";
+    string tmp = path + ".tmp";
+    unlink(tmp.c_str());
+
+    // the samples as ordinary archive blocks, oldest first
+    unique_ptr<PSARCHIVE> archive(new PSARCHIVE());
+    if ( ! archive->open(tmp.c_str()))
+        return false;
+    for (uint32_t i = 0; i < filled; i++)
+        archive->append(pre[(head + PSR_PRE_SAMPLES - filled + i) % PSR_PRE_SAMPLES]);
+    for (uint32_t i = 0; i < posted; i++)
+        archive->append(post[i]);
+    archive->close();
+
+    summary.pre = filled;
+    summary.post = posted;
+    summary.crc = PSARCHIVE::crc32(0, (const uint8_t *)&summary, offsetof(psrSummary, crc));
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_APPEND);
+    bool ok = fd >= 0 && ::write(fd, &summary, sizeof(summary)) == sizeof(summary);
+    if (fd >= 0) {
+        ok = fdatasync(fd) == 0 && ok;
+        ::close(fd);
+    }
+    if (ok)
+        ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if ( ! ok) {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    // the post window is the start of the next pre window
+    head = filled = 0;
+    for (uint32_t i = 0; i < posted; i++)
+        record(post[i]);
+    posted = 0;
+    
+    written = path;
+    return true;
+}
+
+//******************************************************************
+bool PSRECORDER::nextCapture(string &path)
+{
+    if (written.empty())
+        return false;
+
+    path = written;
+    written.clear();
+    return true;
+}
+
+//******************************************************************
+bool PSRECORDER::readSummary(const char *path, psrSummary &out)
+{
+    FILE *fin = fopen(path, "r");
+    if ( ! fin)
+        return false;
+
+    bool ok = fseek(fin, -(long)sizeof(out), SEEK_END) == 0 && fread(&out, sizeof(out), 1, fin) == 1;
+    fclose(fin);
+
+    return ok && out.magic == PSR_MAGIC && out.version == PSR_VERSION
+              && out.crc == PSARCHIVE::crc32(0, (const uint8_t *)&out, offsetof(psrSummary, crc));
+}
@@ -0,0 +1,78 @@
+/***************************************************************
+*  Program:      PSrecorder.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star fault flight recorder .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <string>
+
+/*
+ * Keeps the last PSR_PRE_SAMPLES getStatus samples in a ring.  A fault
+ * edge freezes the ring, the next PSR_POST_SAMPLES samples are collected
+ * and the whole capture is written to one file:
+ *
+ *   archive block(s) of the samples | psrSummary
+ *
+ * so psquery -f <capture> reads the telemetry like any archive, and
+ * psquery -f <capture> capture prints the fault summary.
+ *
+ * Until a fault trips, record() is a single sample copy into the ring.
+ */
+
+#define PS_RECORDER_DIR     "/var/log"
+#define PS_RECORDER_PREFIX  "powerstar-fault-"      // + yyyymmdd-hhmmss.psf
+
+#define PSR_MAGIC           0x52465350      // "PSFR"
+#define PSR_VERSION         1
+#define PSR_PRE_SAMPLES     120             // 2 min at 1 Hz
+#define PSR_POST_SAMPLES    30
+#define PSR_MAX_EVENTS      16              // fault edges kept per capture
+
+#pragma pack(push, 1)
+typedef struct {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t events;                // edges in event[]
+            uint64_t trigger;               // ms since epoch of the first edge
+            uint32_t pre;                   // samples up to the trigger
+            uint32_t post;                  // samples after it
+            psFaultEvent event[PSR_MAX_EVENTS];
+            uint32_t crc;                   // crc32 of the summary to here
+} psrSummary;
+#pragma pack(pop)
+
+class PSRECORDER
+{
+    public:
+        bool    open(const char *dir);
+        void    close();
+
+        // poll path
+        void    record(const psSample &sample);
+        void    trigger(const psFaultEvent &event);
+        bool    capturing() { return triggered; }
+
+        // path of a capture written since the last call
+        bool    nextCapture(string &path);
+
+        // summary at the end of a capture file
+        static bool readSummary(const char *path, psrSummary &summary);
+
+    private:
+        bool    write();
+
+        string   dir;
+        string   written;
+
+        psSample pre[PSR_PRE_SAMPLES];
+        uint32_t head { 0 };                // next ring slot
+        uint32_t filled { 0 };
+        psSample post[PSR_POST_SAMPLES];
+        uint32_t posted { 0 };
+        bool     triggered { false };
+        psrSummary summary;
+};
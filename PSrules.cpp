@@ -0,0 +1,524 @@
+/***************************************************************
+*  Program:      PSrules.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star alert rules
+****************************************************************/
+
+#include "PSrules.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+using namespace std;
+
+static const char *extraVars[]  = { "DewPt", "DpDep", "Faults" };
+
+//******************************************************************
+// Recursive descent over one condition, appending ops to code
+namespace {
+
+typedef enum { T_END, T_NUM, T_NAME, T_OP, T_LPAREN, T_RPAREN } TOKEN;
+
+class psrParser
+{
+    public:
+        psrParser(const char *text, vector<psrOp> &ops) : p(text), code(ops) { next(); }
+
+        bool    expr()          { return orExpr(); }
+        bool    keyword(const char *word) { return tok == T_NAME && strcasecmp(name, word) == 0; }
+
+        TOKEN   tok;
+        char    name[32];
+        float   num;
+        const char *at;                     // start of the current token
+        const char *p;                      // just past it
+        string  error;
+        int     depth { 0 }, maxDepth { 0 };
+
+        void next()
+        {
+            while (isspace(*p))
+                p++;
+            at = p;
+
+            char *end;
+            if (*p == 0)
+                tok = T_END;
+            else if (isdigit(*p) || (*p == '.' && isdigit(p[1]))) {
+                num = strtof(p, &end);
+                p = end;
+                tok = T_NUM;
+            }
+            else if (isalpha(*p) || *p == '_') {
+                int n = 0;
+                while ((isalnum(*p) || *p == '_' || *p == '.') && n < (int)sizeof(name) - 1)
+                    name[n++] = *p++;
+                name[n] = 0;
+                tok = T_NAME;
+            }
+            else if (*p == '(' || *p == ')') {
+                tok = *p++ == '(' ? T_LPAREN : T_RPAREN;
+            }
+            else {
+                static const char *ops[] = { "<=", ">=", "==", "!=", "&&", "||", "<", ">", "+", "-", "*", "/", "!" };
+                tok = T_END;
+                for (const char *o : ops)
+                    if (strncmp(p, o, strlen(o)) == 0) {
+                        strcpy(name, o);
+                        p += strlen(o);
+                        tok = T_OP;
+                        break;
+                    }
+                if (tok == T_END)
+                    fail(string("unexpected '") + *p + "'");
+            }
+        }
+
+        bool fail(const string &why)
+        {
+            if (error.empty())
+                error = why;
+            return false;
+        }
+
+    private:
+        vector<psrOp> &code;
+
+        void emit(PSR_OP op, uint8_t var = 0, float k = 0)
+        {
+            code.push_back({ (uint8_t)op, var, k });
+
+            // stack depth the program will reach
+            if (op == PSR_LOAD || op == PSR_CONST || op == PSR_FAULT)
+                maxDepth = max(maxDepth, ++depth);
+            else if (op >= PSR_ADD)
+                depth--;
+        }
+
+        bool isOp(const char *o)    { return tok == T_OP && strcmp(name, o) == 0; }
+
+        bool orExpr()
+        {
+            if ( ! andExpr())
+                return false;
+            while (keyword("or") || isOp("||")) {
+                next();
+                if ( ! andExpr())
+                    return false;
+                emit(PSR_OR);
+            }
+            return true;
+        }
+
+        bool andExpr()
+        {
+            if ( ! notExpr())
+                return false;
+            while (keyword("and") || isOp("&&")) {
+                next();
+                if ( ! notExpr())
+                    return false;
+                emit(PSR_AND);
+            }
+            return true;
+        }
+
+        bool notExpr()
+        {
+            if (keyword("not") || isOp("!")) {
+                next();
+                if ( ! notExpr())
+                    return false;
+                emit(PSR_NOT);
+                return true;
+            }
+            return compare();
+        }
+
+        bool compare()
+        {
+            static const char *ops[] = { "<", "<=", ">", ">=", "==", "!=" };
+
+            if ( ! sum())
+                return false;
+            for (int i = 0; i < 6; i++)
+                if (isOp(ops[i])) {
+                    next();
+                    if ( ! sum())
+                        return false;
+                    emit((PSR_OP)(PSR_LT + i));
+                    break;
+                }
+            return true;
+        }
+
+        bool sum()
+        {
+            if ( ! term())
+                return false;
+            while (isOp("+") || isOp("-")) {
+                PSR_OP op = isOp("+") ? PSR_ADD : PSR_SUB;
+                next();
+                if ( ! term())
+                    return false;
+                emit(op);
+            }
+            return true;
+        }
+
+        bool term()
+        {
+            if ( ! unary())
+                return false;
+            while (isOp("*") || isOp("/")) {
+                PSR_OP op = isOp("*") ? PSR_MUL : PSR_DIV;
+                next();
+                if ( ! unary())
+                    return false;
+                emit(op);
+            }
+            return true;
+        }
+
+        bool unary()
+        {
+            if (isOp("-")) {
+                next();
+                if ( ! unary())
+                    return false;
+                emit(PSR_NEG);
+                return true;
+            }
+            return primary();
+        }
+
+        bool primary()
+        {
+            if (tok == T_NUM) {
+                emit(PSR_CONST, 0, num);
+                next();
+                return true;
+            }
+
+            if (tok == T_LPAREN) {
+                next();
+                if ( ! orExpr())
+                    return false;
+                if (tok != T_RPAREN)
+                    return fail("missing )");
+                next();
+                return true;
+            }
+
+            // fault(<bit>)
+            if (keyword("fault")) {
+                next();
+                if (tok != T_LPAREN)
+                    return fail("expected fault(<bit>)");
+                next();
+                if (tok != T_NUM || num < 0 || num > 31 || num != (int)num)
+                    return fail("fault bit is 0 to 31");
+                emit(PSR_FAULT, (uint8_t)num);
+                next();
+                if (tok != T_RPAREN)
+                    return fail("missing )");
+                next();
+                return true;
+            }
+
+            if (tok == T_NAME) {
+                for (int c = 0; c < PSR_NVARS; c++) {
+                    const char *n = c < PS_NCHAN ? psChannels[c].name : extraVars[c - PS_NCHAN];
+                    if (strcasecmp(name, n) == 0) {
+                        emit(PSR_LOAD, c);
+                        next();
+                        return true;
+                    }
+                }
+                return fail(string("unknown name ") + name);
+            }
+
+            return fail("expected a value");
+        }
+};
+
+}
+
+//******************************************************************
+PSRULES::~PSRULES()
+{
+    close();
+}
+
+//******************************************************************
+bool PSRULES::open(const char *path, string &error)
+{
+    close();
+
+    FILE *fin = fopen(path, "r");
+    if ( ! fin) {
+        error = string("can't read ") + path;
+        return false;
+    }
+
+    char line[512];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fin)) {
+        lineNo++;
+        line[strcspn(line, "#\r\n")] = 0;
+
+        char *s = line;
+        while (isspace(*s))
+            s++;
+        if (*s == 0)
+            continue;
+
+        string why;
+        if (strncmp(s, "hook", 4) == 0 && isspace(s[4])) {
+            s += 4;
+            while (isspace(*s))
+                s++;
+            hook = s;
+            hook.erase(hook.find_last_not_of(" \t") + 1);
+        }
+        else if ( ! compile(s, why)) {
+            error = "line " + to_string(lineNo) + ": " + why;
+            fclose(fin);
+            close();
+            return false;
+        }
+    }
+    fclose(fin);
+
+    log = fopen(PS_ALERT_LOG, "a");
+    return true;
+}
+
+//******************************************************************
+void PSRULES::close()
+{
+    reap();
+    code.clear();
+    rules.clear();
+    alerts.clear();
+    hook.clear();
+    needDew = false;
+    if (log)
+        fclose(log);
+    log = nullptr;
+}
+
+//******************************************************************
+// name: condition [for <n>s|m] [clear condition]
+bool PSRULES::compile(const string &text, string &error)
+{
+    size_t colon = text.find(':');
+    if (colon == string::npos || colon == 0) {
+        error = "expected <name>: <condition>";
+        return false;
+    }
+
+    psrRule rule;
+    rule.name = text.substr(0, colon);
+    rule.name.erase(rule.name.find_last_not_of(" \t") + 1);
+    rule.text = text.substr(colon + 1);
+    rule.text.erase(0, rule.text.find_first_not_of(" \t"));
+    rule.clear = -1;
+    rule.forMs = 0;
+    rule.raised = false;
+    rule.since = 0;
+
+    vector<psrOp> ops;
+    psrParser parser(rule.text.c_str(), ops);
+
+    rule.cond = code.size();
+    bool ok = parser.expr();
+    ops.push_back({ PSR_END, 0, 0 });
+    size_t condLen = parser.at - rule.text.c_str();
+
+    if (ok && parser.keyword("for")) {
+        parser.next();
+        if (parser.tok != T_NUM) {
+            error = "expected a time after for";
+            return false;
+        }
+        float secs = parser.num;
+        if (*parser.p == 'm')
+            secs *= 60, parser.p++;
+        else if (*parser.p == 's')
+            parser.p++;
+        rule.forMs = secs * 1000;
+        parser.next();
+    }
+
+    if (ok && parser.keyword("clear")) {
+        parser.next();
+        rule.clear = rule.cond + ops.size();
+        ok = parser.expr();
+        ops.push_back({ PSR_END, 0, 0 });
+    }
+
+    if (ok && parser.tok != T_END)
+        parser.fail("unexpected text after the condition");
+    if ( ! parser.error.empty()) {
+        error = parser.error;
+        return false;
+    }
+    if (parser.maxDepth > PSR_STACK) {
+        error = "condition too deep";
+        return false;
+    }
+
+    for (const psrOp &op : ops) {
+        code.push_back(op);
+        if (op.op == PSR_LOAD && (op.var == PSR_DEWPT || op.var == PSR_DPDEP))
+            needDew = true;
+    }
+
+    // the alert shows the condition, not the for/clear parts
+    rule.text.erase(condLen);
+    rule.text.erase(rule.text.find_last_not_of(" \t") + 1);
+    rules.push_back(rule);
+    return true;
+}
+
+//******************************************************************
+float PSRULES::run(uint32_t pc)
+{
+    float stack[PSR_STACK];
+    int sp = -1;
+
+    for (const psrOp *o = &code[pc]; ; o++) {
+        switch (o->op) {
+            case PSR_LOAD:  stack[++sp] = vars[o->var]; break;
+            case PSR_CONST: stack[++sp] = o->k; break;
+            case PSR_FAULT: stack[++sp] = faultWord >> o->var & 1; break;
+            case PSR_NEG:   stack[sp] = -stack[sp]; break;
+            case PSR_NOT:   stack[sp] = stack[sp] == 0; break;
+            case PSR_ADD:   sp--; stack[sp] += stack[sp + 1]; break;
+            case PSR_SUB:   sp--; stack[sp] -= stack[sp + 1]; break;
+            case PSR_MUL:   sp--; stack[sp] *= stack[sp + 1]; break;
+            case PSR_DIV:   sp--; stack[sp] = stack[sp + 1] != 0 ? stack[sp] / stack[sp + 1] : 0; break;
+            case PSR_LT:    sp--; stack[sp] = stack[sp] <  stack[sp + 1]; break;
+            case PSR_LE:    sp--; stack[sp] = stack[sp] <= stack[sp + 1]; break;
+            case PSR_GT:    sp--; stack[sp] = stack[sp] >  stack[sp + 1]; break;
+            case PSR_GE:    sp--; stack[sp] = stack[sp] >= stack[sp + 1]; break;
+            case PSR_EQ:    sp--; stack[sp] = stack[sp] == stack[sp + 1]; break;
+            case PSR_NE:    sp--; stack[sp] = stack[sp] != stack[sp + 1]; break;
+            case PSR_AND:   sp--; stack[sp] = stack[sp] != 0 && stack[sp + 1] != 0; break;
+            case PSR_OR:    sp--; stack[sp] = stack[sp] != 0 || stack[sp + 1] != 0; break;
+            default:       return sp >= 0 ? stack[sp] : 0;
+        }
+    }
+}
+
+//******************************************************************
+void PSRULES::evaluate(const psSample &sample, uint32_t faults)
+{
+    reap();
+
+    memcpy(vars, sample.value, sizeof(sample.value));
+    vars[PSR_FAULTS] = faults;
+    faultWord = faults;
+
+    // Magnus dew point, Temp is in F
+    if (needDew) {
+        float tc = (vars[PS_CH_TEMP] - 32) * 5 / 9;
+        float g = logf(max(vars[PS_CH_HUM], 1.0f) / 100) + 17.62f * tc / (243.12f + tc);
+        vars[PSR_DEWPT] = 243.12f * g / (17.62f - g) * 9 / 5 + 32;
+        vars[PSR_DPDEP] = vars[PS_CH_TEMP] - vars[PSR_DEWPT];
+    }
+
+    for (psrRule &rule : rules) {
+        bool cond = run(rule.cond) != 0;
+        if ( ! cond)
+            rule.since = 0;
+        else if (rule.since == 0)
+            rule.since = sample.time;
+
+        if ( ! rule.raised) {
+            if (cond && sample.time - rule.since >= rule.forMs) {
+                rule.raised = true;
+                emit(rule, sample.time, true);
+            }
+        }
+        else if (rule.clear < 0 ? ! cond : run(rule.clear) != 0) {
+            rule.raised = false;
+            emit(rule, sample.time, false);
+        }
+    }
+}
+
+//******************************************************************
+void PSRULES::emit(const psrRule &rule, uint64_t time, bool raised)
+{
+    psAlert alert;
+    alert.time = time;
+    alert.raised = raised;
+    snprintf(alert.rule, sizeof(alert.rule), "%s", rule.name.c_str());
+    snprintf(alert.condition, sizeof(alert.condition), "%s", rule.text.c_str());
+
+    if (alerts.size() == PSR_ALERTS)
+        alerts.pop_front();
+    alerts.push_back(alert);
+
+    if (log) {
+        time_t secs = time / 1000;
+        struct tm tm;
+        char stamp[32];
+        localtime_r(&secs, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        fprintf(log, "%s %s %s: %s\n", stamp, raised ? "RAISED" : "CLEARED", alert.rule, alert.condition);
+        fflush(log);
+    }
+
+    // the hook must never hold up the poll
+    if ( ! hook.empty()) {
+        int pid = fork();
+        if (pid == 0) {
+            execl(hook.c_str(), hook.c_str(), alert.rule, raised ? "raised" : "cleared", alert.condition, (char *)nullptr);
+            _exit(127);
+        }
+        if (pid > 0)
+            children.push_back(pid);
+    }
+}
+
+//******************************************************************
+// Collect hooks that have finished
+void PSRULES::reap()
+{
+    for (size_t i = 0; i < children.size(); )
+        if (waitpid(children[i], nullptr, WNOHANG) != 0)
+            children.erase(children.begin() + i);
+        else
+            i++;
+}
+
+//******************************************************************
+bool PSRULES::nextAlert(psAlert &alert)
+{
+    if (alerts.empty())
+        return false;
+
+    alert = alerts.front();
+    alerts.pop_front();
+    return true;
+}
+
+//******************************************************************
+string PSRULES::active()
+{
+    string names;
+
+    for (const psrRule &rule : rules)
+        if (rule.raised)
+            names += (names.empty() ? "" : ", ") + rule.name;
+    return names;
+}
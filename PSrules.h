@@ -0,0 +1,120 @@
+/***************************************************************
+*  Program:      PSrules.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star alert rules .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+ * Alert rules, one per line:
+ *
+ *   # comment
+ *   hook /usr/local/bin/ps-alert
+ *   lowvolt:  IN.volts < 11.8 for 30s clear IN.volts > 12.0
+ *   deadheat: Dew1.current == 0 and Dew1.set > 0 for 60s
+ *   damp:     Hum > 90 and DpDep < 2
+ *   outtrip:  fault(8) or fault(16)
+ *
+ * Names are the archive channel names (psquery info), plus DewPt and
+ * DpDep (F, from Temp and Hum) and Faults, nonzero when any fault is
+ * active.  fault(n) is 1 while bit n of the getFaultStatus word is set
+ * (bits in PSfaults.h), tested on the word itself, not a float copy.
+ * Operators: + - * / < <= > >= == != and or not ( ), && || ! too.
+ *
+ * A rule raises once its condition has held for the 'for' time and
+ * clears when its 'clear' condition is true, or when the condition is
+ * false if there is no clear.
+ *
+ * Every condition is compiled once into one flat stack program, so a
+ * poll costs a few ops per rule term.  Each edge goes to the alert log,
+ * the event queue (INDI messages) and the hook, which is run without
+ * waiting as: hook <rule> raised|cleared <condition>
+ */
+
+#define PS_RULES_FILE       "/etc/powerstar.rules"
+#define PS_ALERT_LOG        "/var/log/powerstar-alerts.log"
+
+#define PSR_STACK           32
+#define PSR_ALERTS          64              // edges kept until taken
+
+// Rule variables past the archive channels
+typedef enum { PSR_DEWPT = PS_NCHAN,
+               PSR_DPDEP,
+               PSR_FAULTS,
+               PSR_NVARS
+} PSR_VAR;
+
+// Compiled condition, a stack program ending in PSR_END
+typedef enum { PSR_LOAD,                    // push vars[var]
+               PSR_CONST,                   // push k
+               PSR_FAULT,                   // push bit var of the fault word
+               PSR_NEG, PSR_NOT,            // unary, on the top
+               PSR_ADD, PSR_SUB, PSR_MUL, PSR_DIV,
+               PSR_LT, PSR_LE, PSR_GT, PSR_GE, PSR_EQ, PSR_NE,
+               PSR_AND, PSR_OR,
+               PSR_END
+} PSR_OP;
+
+typedef struct {
+            uint8_t  op;
+            uint8_t  var;
+            float    k;
+} psrOp;
+
+typedef struct {
+            uint64_t time;                  // ms since epoch
+            bool     raised;
+            char     rule[32];
+            char     condition[96];
+} psAlert;
+
+class PSRULES
+{
+    public:
+        ~PSRULES();
+
+        // parse and compile, error is "line n: why" on failure
+        bool    open(const char *path, string &error);
+        void    close();
+
+        // poll path
+        void    evaluate(const psSample &sample, uint32_t faults);
+
+        bool    nextAlert(psAlert &alert);
+        string  active();                   // names of raised rules
+        size_t  count() { return rules.size(); }
+
+    private:
+        typedef struct {
+            string   name;
+            string   text;
+            uint32_t cond;                  // start of the condition in code
+            int32_t  clear;                 // start of the clear condition, -1: none
+            uint32_t forMs;
+            bool     raised;
+            uint64_t since;                 // condition true since, 0: false
+        } psrRule;
+
+        bool    compile(const string &text, string &error);
+        float   run(uint32_t pc);
+        void    emit(const psrRule &rule, uint64_t time, bool raised);
+        void    reap();
+
+        vector<psrOp>   code;
+        vector<psrRule> rules;
+        float           vars[PSR_NVARS];
+        uint32_t        faultWord { 0 };
+        bool            needDew { false };
+
+        string          hook;
+        FILE           *log { nullptr };
+        deque<psAlert>  alerts;
+        vector<int>     children;
+};
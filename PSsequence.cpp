@@ -0,0 +1,383 @@
+/***************************************************************
+*  Program:      PSsequence.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star power-up/down sequencing
+****************************************************************/
+
+#include "PSsequence.h"
+#include "PSports.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+using namespace std;
+
+static double monoMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+//******************************************************************
+// <port> on|off|<percent> [after ms] [settle A/s] [below A] [within ms]
+static bool parseStep(const char *s, psSeqStep &step, string &why)
+{
+    char name[16], action[16];
+    int used;
+    if (sscanf(s, "%15s %15s%n", name, action, &used) != 2) {
+        why = "expected <port> on|off|<percent>";
+        return false;
+    }
+
+    // switched by PS_PORT_CTL, or a dew heater
+    int n = psPortIndex(name);
+    bool dew = n == PSE_DEW1 || n == PSE_DEW2;
+    if (n < 0 || psPorts[n].fixed || ! (psPorts[n].mask || dew)) {
+        why = string("unknown or unswitchable port '") + name + "'";
+        return false;
+    }
+
+    step = psSeqStep {};
+    strcpy(step.name, psPorts[n].name);
+    step.bit = psPorts[n].mask;
+    step.port = psPorts[n].amps >= 0 ? n : -1;
+    step.withinMs = PSQ_WITHIN_MS;
+
+    if (strcasecmp(action, "on") == 0)
+        step.level = dew ? 100 : 1;
+    else if (strcasecmp(action, "off") == 0)
+        step.level = 0;
+    else if (dew && isdigit(action[0]) && atoi(action) <= 100)
+        step.level = atoi(action);
+    else {
+        why = string("'") + action + "' is not " + (dew ? "on, off or a percent" : "on or off");
+        return false;
+    }
+
+    char key[16];
+    float value;
+    for (s += used; sscanf(s, " %15s %f%n", key, &value, &used) == 2 && value >= 0; s += used) {
+        if (strcasecmp(key, "after") == 0)
+            step.afterMs = value;
+        else if (strcasecmp(key, "settle") == 0)
+            step.settle = value;
+        else if (strcasecmp(key, "below") == 0)
+            step.below = value;
+        else if (strcasecmp(key, "within") == 0)
+            step.withinMs = value;
+        else {
+            why = string("unknown '") + key + "'";
+            return false;
+        }
+    }
+    while (isspace(*s))
+        s++;
+    if (*s) {
+        why = string("can't read '") + s + "'";
+        return false;
+    }
+
+    if ((step.settle > 0 || step.below > 0) && step.port < 0) {
+        why = string(step.name) + " has no current to settle on";
+        return false;
+    }
+    if (step.below > 0 && step.settle == 0)
+        step.settle = 1e9;
+    return true;
+}
+
+//******************************************************************
+PSSEQUENCE::~PSSEQUENCE()
+{
+    stop();
+}
+
+//******************************************************************
+bool PSSEQUENCE::load(const char *path, string &error)
+{
+    upPlan.clear();
+    downPlan.clear();
+
+    FILE *fin = fopen(path, "r");
+    if ( ! fin) {
+        error = string("can't read ") + path;
+        return false;
+    }
+
+    vector<psSeqStep> *plan = &upPlan;
+    bool haveDown = false;
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), fin)) {
+        lineNo++;
+        line[strcspn(line, "#\r\n")] = 0;
+
+        char *s = line;
+        while (isspace(*s))
+            s++;
+        if (*s == 0)
+            continue;
+
+        string why;
+        psSeqStep step;
+        if (strncasecmp(s, "[up]", 4) == 0)
+            plan = &upPlan;
+        else if (strncasecmp(s, "[down]", 6) == 0) {
+            plan = &downPlan;
+            haveDown = true;
+        }
+        else if (*s == '[')
+            why = "expected [up] or [down]";
+        else if (parseStep(s, step, why))
+            plan->push_back(step);
+
+        if ( ! why.empty()) {
+            error = "line " + to_string(lineNo) + ": " + why;
+            fclose(fin);
+            upPlan.clear();
+            downPlan.clear();
+            return false;
+        }
+    }
+    fclose(fin);
+
+    // everything off, last on first off, as fast as it goes
+    if ( ! haveDown)
+        for (auto step = upPlan.rbegin(); step != upPlan.rend(); step++) {
+            psSeqStep off = *step;
+            off.level = 0;
+            off.afterMs = 0;
+            off.settle = off.below = 0;
+            downPlan.push_back(off);
+        }
+
+    if (upPlan.empty() && downPlan.empty()) {
+        error = "no steps";
+        return false;
+    }
+    return true;
+}
+
+//******************************************************************
+bool PSSEQUENCE::start(bool up)
+{
+    if (active)
+        return false;
+    if (worker.joinable())
+        worker.join();
+
+    steps = plan(up);
+    if (steps.empty())
+        return false;
+
+    // a fresh poll for the power budget and the dew current scale
+    psctl.getStatus();
+    if ( ! psctl.getPortStatus(&ports))
+        return false;
+
+    lock_guard<mutex> guard(lock);
+    memset(&stats, 0, sizeof(stats));
+    stats.steps = steps.size();
+    done.clear();
+    stopping = false;
+    active = true;
+    worker = thread(&PSSEQUENCE::run, this);
+    return true;
+}
+
+//******************************************************************
+void PSSEQUENCE::stop()
+{
+    stopping = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+//******************************************************************
+psSeqProgress PSSEQUENCE::progress()
+{
+    lock_guard<mutex> guard(lock);
+    psSeqProgress out = stats;
+    if (active)
+        out.seconds = (monoMs() - begin) / 1000;
+    return out;
+}
+
+//******************************************************************
+vector<psSeqResult> PSSEQUENCE::results()
+{
+    lock_guard<mutex> guard(lock);
+    return done;
+}
+
+//******************************************************************
+void PSSEQUENCE::fail(const string &why)
+{
+    lock_guard<mutex> guard(lock);
+    stats.failed = true;
+    snprintf(stats.reason, sizeof(stats.reason), "%s", why.c_str());
+}
+
+//******************************************************************
+// Sleeps to an absolute deadline, false if stopped first
+bool PSSEQUENCE::waitUntil(double ms)
+{
+    while ( ! stopping) {
+        double now = monoMs();
+        if (now >= ms)
+            return true;
+
+        double wake = min(ms, now + 100);
+        struct timespec ts;
+        ts.tv_sec = wake / 1000;
+        ts.tv_nsec = (wake - ts.tv_sec * 1000.0) * 1e6;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+    return false;
+}
+
+//******************************************************************
+// Reads the port's current until it stops changing, a held USB session
+// is given up now and then and held says if it is still open
+bool PSSEQUENCE::settle(const psSeqStep &step, psSeqResult &result, bool &held)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stats.settling = true;
+    }
+
+    double start = monoMs(), turn = start, windowAt = 0;
+    float windowAmps = 0;
+
+    while ( ! stopping) {
+        float amps;
+        bool ok = psctl.getCurrent(step.port, &amps);
+        double t = monoMs();
+
+        if (ok) {
+            result.peakAmps = max(result.peakAmps, amps);
+            result.amps = amps;
+
+            if (windowAt == 0) {
+                windowAt = t;
+                windowAmps = amps;
+            }
+            else if (t - windowAt >= PSQ_WINDOW_MS) {
+                float slope = fabs(amps - windowAmps) * 1000 / (t - windowAt);
+                if (slope <= step.settle && (step.below == 0 || amps <= step.below)) {
+                    result.settleMs = t - start;
+                    return true;
+                }
+                windowAt = t;
+                windowAmps = amps;
+            }
+        }
+
+        if (t - start > step.withinMs) {
+            result.settleMs = t - start;
+            result.ok = false;
+            char why[80];
+            snprintf(why, sizeof(why), "%s not settled in %u ms, at %.2fA", step.name, step.withinMs, result.amps);
+            fail(why);
+            return false;
+        }
+
+        // give the USB up for a moment, only if it is ours to give
+        if (held && t - turn >= PSQ_HOLD_MS) {
+            psctl.hidEnd();
+            usleep(PSQ_YIELD_US);
+            held = psctl.hidBegin();
+            turn = monoMs();
+        }
+    }
+
+    result.ok = false;
+    fail("stopped");
+    return false;
+}
+
+//******************************************************************
+void PSSEQUENCE::run()
+{
+    begin = monoMs();
+    double due = begin;                 // the next step may go from here
+    size_t i = 0;
+
+    while (i < steps.size()) {
+        const psSeqStep &first = steps[i];
+        if ( ! waitUntil(due + first.afterMs)) {
+            fail("stopped");
+            break;
+        }
+
+        // port steps with nothing to wait for between them go out together
+        size_t j = i + 1;
+        if (first.bit)
+            while (j < steps.size() && steps[j].bit && steps[j].afterMs == 0 && steps[j - 1].settle == 0)
+                j++;
+
+        {
+            lock_guard<mutex> guard(lock);
+            stats.step = i;
+            stats.settling = false;
+        }
+
+        bool held = psctl.hidBegin();
+        double at = monoMs();
+        bool ok;
+        uint16_t refused = 0;
+        if (first.bit) {
+            uint16_t want = ports;
+            for (size_t k = i; k < j; k++)
+                want = steps[k].level ? want | steps[k].bit : want & ~steps[k].bit;
+            ok = psctl.setPortStatus(want, &refused);
+            if (ok)
+                ports = want & ~refused;
+        }
+        else
+            ok = psctl.setDew(first.port - PSE_DEW1, first.level);
+
+        // the ports the budget turned down failed, the rest of the batch went out
+        vector<psSeqResult> batch(j - i);
+        for (size_t k = i; k < j; k++) {
+            psSeqResult &r = batch[k - i];
+            memset(&r, 0, sizeof(r));
+            strcpy(r.name, steps[k].name);
+            r.atMs = at - begin;
+            r.ok = ok && ! (refused & steps[k].bit);
+        }
+
+        string note;
+        if ( ! ok)
+            fail(psctl.nextBudgetNote(note) ? note : string(first.name) + " command failed");
+        else if (refused) {
+            fail(psctl.nextBudgetNote(note) ? note : "over the power budget");
+            ok = false;
+        }
+        else if (steps[j - 1].settle > 0)
+            ok = settle(steps[j - 1], batch.back(), held);
+
+        if (held)
+            psctl.hidEnd();
+
+        lock_guard<mutex> guard(lock);
+        done.insert(done.end(), batch.begin(), batch.end());
+        if ( ! ok)
+            break;
+        i = j;
+        due = monoMs();
+    }
+
+    lock_guard<mutex> guard(lock);
+    if (i == steps.size())
+        stats.step = i;
+    stats.settling = false;
+    stats.seconds = (monoMs() - begin) / 1000;
+    active = false;
+}
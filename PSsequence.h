@@ -0,0 +1,119 @@
+/***************************************************************
+*  Program:      PSsequence.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star power-up/down sequencing .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include "PSenergy.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Power-up and power-down plans, one step per line:
+ *
+ *   # comment
+ *   [up]
+ *   Out1  on                settle 0.5 within 3000     # mount
+ *   Out2  on   after 500    settle 0.2 below 2.5       # camera
+ *   USB2  on
+ *   Dew1  40
+ *   [down]
+ *   Dew1  off
+ *   ...
+ *
+ * A step switches a port on or off (a dew heater to a percent), 'after'
+ * ms from the end of the step before.  With 'settle' it then reads the
+ * port's current back to back until it changes less than that many A/s
+ * (and is under 'below' amps), failing after 'within' ms.  A failed step
+ * ends the plan.  Without a [down] plan, down is up backwards, all off.
+ *
+ * Nothing waits longer than asked: port steps with no delay or settle
+ * between them go out as one PS_PORT_CTL, and delays are slept to an
+ * absolute monotonic deadline.  The plan runs on its own thread, with
+ * the USB held while switching and settling and released while waiting.
+ * Like the current watch, other PSCTL calls must not be made from
+ * another thread while it runs.  Port commands still go through the
+ * power budget.
+ */
+
+#define PS_SEQUENCE_FILE    "/etc/powerstar.sequence"
+
+#define PSQ_WITHIN_MS       5000            // default settle limit
+#define PSQ_WINDOW_MS       50              // settle slope measured over this
+#define PSQ_HOLD_MS         500             // USB held this long per turn
+#define PSQ_YIELD_US        2000            // then let other processes in
+
+typedef struct {
+            char     name[8];
+            uint16_t bit;                   // PS_PORT_CTL bit, 0: dew heater
+            int8_t   port;                  // PSE_PORT of its current, -1: none
+            uint8_t  level;                 // 0/1 off/on, dew: %
+            uint32_t afterMs;
+            float    settle;                // A/s, 0: don't wait
+            float    below;                 // A, 0: any
+            uint32_t withinMs;
+} psSeqStep;
+
+typedef struct {
+            char     name[8];
+            double   atMs;                  // switched, ms after the start
+            double   settleMs;              // switch to settled, 0: not waited for
+            float    peakAmps;
+            float    amps;                  // when settled
+            bool     ok;
+} psSeqResult;
+
+typedef struct {
+            int      step;                  // running now, steps when done
+            int      steps;
+            double   seconds;
+            bool     settling;
+            bool     failed;
+            char     reason[80];
+} psSeqProgress;
+
+class PSSEQUENCE
+{
+    public:
+        PSSEQUENCE(PSCTL &ctl) : psctl(ctl) {}
+        ~PSSEQUENCE();
+
+        // parse, error is "line n: why" on failure
+        bool    load(const char *path, string &error);
+        const vector<psSeqStep> &plan(bool up) { return up ? upPlan : downPlan; }
+
+        bool    start(bool up);
+        void    stop();
+        bool    running() { return active; }
+
+        // snapshots, safe while running
+        psSeqProgress progress();
+        vector<psSeqResult> results();
+
+    private:
+        void    run();
+        bool    waitUntil(double ms);
+        bool    settle(const psSeqStep &step, psSeqResult &result, bool &held);
+        void    fail(const string &why);
+
+        PSCTL            &psctl;
+        vector<psSeqStep> upPlan;
+        vector<psSeqStep> downPlan;
+        vector<psSeqStep> steps;            // the one running
+        uint16_t          ports { 0 };
+        double            begin { 0 };
+
+        std::mutex          lock;
+        psSeqProgress       stats;
+        vector<psSeqResult> done;
+        std::thread         worker;
+        std::atomic<bool>   active { false };
+        std::atomic<bool>   stopping { false };
+};
@@ -0,0 +1,292 @@
+/***************************************************************
+*  Program:      PSshm.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star shared-memory telemetry
+****************************************************************/
+
+#include "PSshm.h"
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+//******************************************************************
+static uint64_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//******************************************************************
+PSSHARED::~PSSHARED()
+{
+    close();
+}
+
+//******************************************************************
+bool PSSHARED::open()
+{
+    close();
+
+    fd = shm_open(PS_SHM_NAME, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        fd = shm_open(PS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    protect(fd);
+
+    if (claim())
+        return true;
+
+    return live();
+}
+
+//******************************************************************
+// Readers trust what is in there: only PS_SHM_GROUP gets at it, or
+// without that group only its creator writes and the rest read
+void PSSHARED::protect(int fd)
+{
+    struct group *grp = getgrnam(PS_SHM_GROUP);
+    bool shared = grp && fchown(fd, (uid_t)-1, grp->gr_gid) == 0;
+
+    // not ours to change if someone else created it
+    fchmod(fd, shared ? 0660 : 0644);
+}
+
+//******************************************************************
+bool PSSHARED::attach()
+{
+    close();
+
+    fd = shm_open(PS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    return live();
+}
+
+//******************************************************************
+void PSSHARED::close()
+{
+    if (seg)
+        munmap(seg, sizeof(psShared));
+    if (fd >= 0)
+        ::close(fd);        // drops the owner flock
+
+    seg = nullptr;
+    fd = -1;
+    owner = false;
+}
+
+//******************************************************************
+// The flock decides ownership, it goes away with the owning process
+bool PSSHARED::claim()
+{
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+        return false;
+
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(psShared)) == 0)
+        map = mmap(nullptr, sizeof(psShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        flock(fd, LOCK_UN);
+        return false;
+    }
+
+    if (seg)
+        munmap(seg, sizeof(psShared));
+    seg = (psShared *)map;
+    owner = true;
+
+    // keep seq moving forward so a reader mid-copy of the old owner retries
+    beginWrite();
+    seg->magic = PSS_MAGIC;
+    seg->version = PSS_VERSION;
+    seg->size = sizeof(psShared);
+    seg->owner = getpid();
+    seg->faults = 0;
+    seg->faultTime = 0;
+    seg->head = 0;
+    seg->energySince = 0;
+    memset(seg->ah, 0, sizeof(seg->ah));
+    memset(seg->wh, 0, sizeof(seg->wh));
+    memset(&seg->status, 0, sizeof(seg->status));
+    endWrite();
+
+    return true;
+}
+
+//******************************************************************
+void PSSHARED::beginWrite()
+{
+    // odd, and changed even if a crashed owner left it odd
+    __atomic_store_n(&seg->seq, (seg->seq + 1) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+//******************************************************************
+void PSSHARED::endWrite()
+{
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELEASE);
+}
+
+//******************************************************************
+uint32_t PSSHARED::beginRead()
+{
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE)) & 1)
+        sched_yield();
+    return seq;
+}
+
+//******************************************************************
+bool PSSHARED::endRead(uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq;
+}
+
+//******************************************************************
+void PSSHARED::publish(const psSample &sample, PSENERGY *meter)
+{
+    if ( ! owner)
+        return;
+
+    beginWrite();
+    seg->status = sample;
+    seg->history[seg->head % PSS_HISTORY] = sample;
+    seg->head++;
+    if (meter) {
+        for (int p = 0; p < PSE_NPORTS; p++) {
+            seg->ah[p] = meter->ampHours(p);
+            seg->wh[p] = meter->wattHours(p);
+        }
+        seg->energySince = meter->since();
+    }
+    endWrite();
+}
+
+//******************************************************************
+void PSSHARED::publishFaults(uint32_t faults)
+{
+    if ( ! owner)
+        return;
+
+    beginWrite();
+    seg->faults = faults;
+    seg->faultTime = nowMs();
+    endWrite();
+}
+
+//******************************************************************
+// Reader: a running owner that has polled recently
+bool PSSHARED::live()
+{
+    if (owner)
+        return true;
+    if (fd < 0)
+        return false;
+
+    if (seg == nullptr) {
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(psShared))
+            return false;
+
+        void *map = mmap(nullptr, sizeof(psShared), PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            return false;
+        seg = (psShared *)map;
+    }
+
+    if (seg->magic != PSS_MAGIC || seg->version != PSS_VERSION || seg->size != sizeof(psShared))
+        return false;
+
+    if (kill(seg->owner, 0) < 0 && errno == ESRCH)
+        return false;
+
+    psSample sample;
+    return latest(sample) && nowMs() - sample.time < PSS_STALE_MS;
+}
+
+//******************************************************************
+bool PSSHARED::latest(psSample &sample)
+{
+    if (seg == nullptr)
+        return false;
+
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t seq = beginRead();
+        sample = seg->status;
+        if (endRead(seq))
+            return sample.time != 0;
+    }
+    return false;
+}
+
+//******************************************************************
+bool PSSHARED::faults(uint32_t *faults)
+{
+    if (seg == nullptr)
+        return false;
+
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t seq = beginRead();
+        uint32_t f = seg->faults;
+        uint64_t t = seg->faultTime;
+        if (endRead(seq)) {
+            *faults = f;
+            return nowMs() - t < PSS_STALE_MS;
+        }
+    }
+    return false;
+}
+
+//******************************************************************
+bool PSSHARED::energy(double ah[PSE_NPORTS], double wh[PSE_NPORTS], uint64_t *since)
+{
+    if (seg == nullptr)
+        return false;
+
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t seq = beginRead();
+        memcpy(ah, seg->ah, sizeof(seg->ah));
+        memcpy(wh, seg->wh, sizeof(seg->wh));
+        *since = seg->energySince;
+        if (endRead(seq))
+            return *since != 0;
+    }
+    return false;
+}
+
+//******************************************************************
+// Oldest first, at most max of the most recent samples
+uint32_t PSSHARED::history(psSample *out, uint32_t max)
+{
+    if (seg == nullptr)
+        return 0;
+
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t seq = beginRead();
+        uint64_t head = seg->head;
+        uint32_t n = min<uint64_t>(min<uint64_t>(head, PSS_HISTORY), max);
+
+        for (uint32_t i = 0; i < n; i++)
+            out[i] = seg->history[(head - n + i) % PSS_HISTORY];
+
+        if (endRead(seq))
+            return n;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+/***************************************************************
+*  Program:      PSshm.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star shared-memory telemetry .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include "PSenergy.h"
+
+/*
+ * One process owns the Power*Star and publishes every decoded status poll
+ * into a POSIX shared-memory segment; any number of readers (the TUI, the
+ * other drivers of this family, scripts) read it without touching USB.
+ *
+ * The owner holds an exclusive flock on the segment for its lifetime, so a
+ * crashed owner frees it automatically.  Updates are protected by a
+ * seqlock: seq is odd while the owner writes, readers copy and retry until
+ * they see the same even seq before and after.
+ *
+ * Readers must check magic, version and size.  Any layout change bumps
+ * PSS_VERSION.
+ */
+
+#define PS_SHM_NAME         "/powerstar"
+#define PS_USB_LOCK_NAME    "/powerstar.usb"
+
+// who may write the segment and take the USB lock, besides their creator
+#ifndef PS_SHM_GROUP
+#define PS_SHM_GROUP        "powerstar"
+#endif
+
+#define PSS_MAGIC           0x4D485350      // "PSHM"
+#define PSS_VERSION         1
+#define PSS_HISTORY         600             // 10 min at 1 Hz
+#define PSS_STALE_MS        5000            // older status is not live
+
+typedef struct {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t size;                  // sizeof(psShared)
+            int32_t  owner;                 // pid of the publisher
+            uint32_t seq;                   // seqlock, odd while updating
+            uint32_t faults;                // getFaultStatus word
+            uint64_t faultTime;             // ms since epoch
+            uint64_t head;                  // samples published so far
+            uint64_t energySince;
+            double   ah[PSE_NPORTS];
+            double   wh[PSE_NPORTS];
+            psSample status;                // latest getStatus
+            psSample history[PSS_HISTORY];  // ring, slot = n % PSS_HISTORY
+} psShared;
+
+class PSSHARED
+{
+    public:
+        ~PSSHARED();
+
+        // become the owner if the segment is free, otherwise attach read only
+        bool    open();
+        // read only, never takes ownership (scripts, psquery)
+        bool    attach();
+        void    close();
+        bool    isOwner() { return owner; }
+        static void protect(int fd);
+
+        // owner side
+        void    publish(const psSample &sample, PSENERGY *meter);
+        void    publishFaults(uint32_t faults);
+
+        // reader side
+        bool    live();
+        bool    latest(psSample &sample);
+        bool    faults(uint32_t *faults);
+        bool    energy(double ah[PSE_NPORTS], double wh[PSE_NPORTS], uint64_t *since);
+        uint32_t history(psSample *out, uint32_t max);
+
+    private:
+        bool    claim();
+        void    beginWrite();
+        void    endWrite();
+        uint32_t beginRead();
+        bool    endRead(uint32_t seq);
+
+        int       fd { -1 };
+        psShared *seg { nullptr };
+        bool      owner { false };
+};
@@ -17,6 +17,13 @@ void printMsg(const std::string& Msg) {
     getline(cin, message);
 }
 
+//************************************************************
+// The power budget's reason if it stopped the command
+void printRefused(PSCTL& psctl, const std::string& Msg) {
+    string note;
+    printMsg(psctl.nextBudgetNote(note) ? note : Msg);
+}
+
 //************************************************************
 bool updateProfile(PSCTL& psctl) {
     FILE *fout = fopen(configFile, "w");
@@ -195,84 +202,25 @@ void askFloat(float * request, float min, float max, const std::string& Msg) {
 void printFaults(PSCTL& psctl) {
     uint32_t faultstat = psctl.getFaultStatus(curProfile.faultMask);
     if ( faultstat ) {
-            if (faultstat & 0xff00)
-                printf("\033[1;31mFatal-FAULT: <%04X> \033[0m  ", ((faultstat & 0xff00) >> 16));
+            if (faultstat & PS_FAULT_LEVEL2)
+                printf("\033[1;31mFatal-FAULT: <%04X> \033[0m  ", (faultstat >> 16));
             
-            //TODO gave Non-Fatal msg but no other fault ..?
-            if (faultstat & 0x00ff)
-                printf("\033[1;31mNon-Fatal FAULT: <%04X> \033[0m \n", (faultstat & 0x00ff));
+            if (faultstat & PS_FAULT_LEVEL1)
+                printf("\033[1;31mNon-Fatal FAULT: <%04X> \033[0m", (faultstat & PS_FAULT_LEVEL1));
+            printf("\n");
             
-            // level 1 byte 1 (non fatal) faults
-            if (faultstat & 0x00000002)
-                printf("Over/Under Voltage on 12V input\n");
-            else if (faultstat & 0x00000004)
-                printf("Over Current on 12V Input\n");
-            else if (faultstat & 0x00000008)
-                printf("Motor temperature sensor\n");
-            else if (faultstat & 0x00000010)
-                printf("Bipolar Motor\n");
-            else if (faultstat & 0x00000020)
-                printf("Internal voltage out of spec\n");
-            else if (faultstat & 0x00000040)
-                printf("Environment sensor\n");
-            else if (faultstat & 0x00000080)
-                printf("Variable voltage over/under voltage by 6.25%% \n");
+            // every active fault, non fatal first
+            uint8_t bits[32];
+            int n = psDecodeFaults(faultstat, bits);
+            for (int i = 0; i < n; i++) {
+                if (psFaults[bits[i]].severity == PS_FAULT_FATAL)
+                    printf("Fatal: %s\n", psFaults[bits[i]].message);
+                else
+                    printf("%s\n", psFaults[bits[i]].message);
+            }
             
-            // level 1 byte 2 (non fatal) faults
-            else if (faultstat & 0x00000100)
-                printf("Out1 over 15A\n");
-            else if (faultstat & 0x00000200)
-                printf("Out2 over 10A\n");
-            else if (faultstat & 0x00000400)
-                printf("Out3 over 6A\n");
-            else if (faultstat & 0x00000800)
-                printf("Out4 over 6A\n");
-            else if (faultstat & 0x00001000)
-                printf("Dew1 over 6A\n");
-            else if (faultstat & 0x00002000)
-                printf("Dew2 over 6A\n");
-            else if (faultstat & 0x00004000)
-                printf("MP over 6A\n");
-            else if (faultstat & 0x00008000)
-                printf("Position Change\n");
-                
-            // Fatal faults:
-            if (faultstat & 0x00000002)
+            if (faultstat & PS_FAULT_LEVEL2)
                 printf("Fatal fault(s) occurred, you will need to restart Power*Star\n");
-            // level 2 byte 1 (fatal) faults
-            else if (faultstat & 0x00010000)
-                printf("Fatal: Out1 over 30A\n");
-            else if (faultstat & 0x00020000)
-                printf("Fatal: Out2 over 20A\n");
-            else if (faultstat & 0x00040000)
-                printf("Fatal: Out3 over 10A\n");
-            else if (faultstat & 0x00080000)
-                printf("Fatal: Out4 over 10A\n");
-            else if (faultstat & 0x00100000)
-                printf("Fatal: Dew1 over 10A\n");
-            else if (faultstat & 0x00200000)
-                printf("Fatal: Dew2 over 10A\n");
-            else if (faultstat & 0x00400000)
-                printf("Fatal: VAR over 10A\n");
-            else if (faultstat & 0x00800000)
-                printf("Fatal: MP over 10A\n");
-            
-            // level 2 byte 2 (fatal) faults
-            else if (faultstat & 0x01000000)
-                printf("Fatal: 12V input under-voltage\n");
-            else if (faultstat & 0x02000000)
-                printf("Fatal: 12V input over-voltage\n");
-            else if (faultstat & 0x04000000)
-                printf("Fatal: Total current over-current\n");
-            else if (faultstat & 0x08000000)
-                printf("Fatal: Current sensor\n");
-            else if (faultstat & 0x10000000)
-                printf("Fatal: Internal 3.3V under-voltage\n");
-            else if (faultstat & 0x20000000)
-                printf("Fatal: Internal 3.3V over-voltage\n");
-            else if (faultstat & 0x40000000)
-                printf("Fatal: Internal 5V under-voltage\n");
-            // 0x80000000 not used
     }
     //else
         //printf("No Faults\n");
@@ -373,7 +321,7 @@ void userLimitsMenu(PSCTL& psctl) {
                 }
 
                 if ( ! psctl.activateProfile(curProfile))
-                    printMsg("Problem activating profile");
+                    printMsg("Problem activating profile: " + psctl.profileReport());
                 
                 break;
             }
@@ -675,7 +623,7 @@ while (true) {
                 }
 
                 if ( ! psctl.activateProfile(curProfile))
-                    printMsg("Problem activating profile");
+                    printMsg("Problem activating profile: " + psctl.profileReport());
                     
                 break;
             }
@@ -688,7 +636,7 @@ while (true) {
                 }
 
                 if ( ! psctl.activateProfile(curProfile))
-                    printMsg("Problem activating profile");
+                    printMsg("Problem activating profile: " + psctl.profileReport());
                 
                 break;
             }
@@ -708,8 +656,6 @@ while (true) {
 void focusMenu(PSCTL& psctl) {
 while (true) {
 
-    actProfile = psctl.getProfileStatus();
-    
     rc = system("clear");
     printf("Power*Star Focus Menu\n\n");
     
@@ -926,7 +872,7 @@ while (true) {
                 }
 
                 if ( ! psctl.activateProfile(curProfile))
-                    printMsg("Problem activating profile");
+                    printMsg("Problem activating profile: " + psctl.profileReport());
                 
                 break;
             }
@@ -947,7 +893,6 @@ void autobootMenu(PSCTL& psctl) {
 while (true) {
 
     psctl.getStatus();
-    actProfile = psctl.getProfileStatus();
     
     rc = system("clear");
     printf("Power*Star AutoBoot Menu\n");
@@ -993,37 +938,43 @@ while (true) {
         char command = cimput[0];
 
         switch(command) {
-            // set auto boot
+            // set auto boot, one or a list of devices (1,2,13)
             case 'e' : {
-                printf("Device Number: ");
+                printf("Device Number(s): ");
                 getline(cin, action);
                 
-                boost::algorithm::to_lower(action);
-                uint8_t usract;
-                try {
-                    usract = stoi(action);
-                }
-                catch (exception &err) {
-                    printMsg("ERROR: Device must be a number between 1 and 14");
-                    break;
+                uint16_t mask = 0;
+                int usract = 0;
+                stringstream numbers(action);
+                string number;
+                while (getline(numbers, number, ',')) {
+                    try {
+                        usract = stoi(number);
+                    }
+                    catch (exception &err) {
+                        usract = 0;
+                    }
+                    uint16_t bit;
+                    if (usract < 1 || usract > 14 || ! psctl.portMask(psctl.Devices[usract-1], true, &bit))
+                        break;
+                    mask |= bit;
                 }
-                if (usract < 1 || usract > 14) {
-                    printMsg("ERROR: Device must be between 1 and 14");
+                if (usract < 1 || usract > 14 || mask == 0) {
+                    printMsg("ERROR: Devices must be numbers between 1 and 14");
                     break;
                 }
                 
-                device =  psctl.Devices[usract-1];
-                boost::algorithm::to_lower(device);
-                
                 printf("On or Off? ");
                 getline(cin, action);
            
                 boost::algorithm::to_lower(action);
-                
-                printf("DIAG: Dev # %i is device: %s", usract, device.c_str());
-                printMsg(" ");
         
-                if ( ! psctl.setAutoBoot(device, action))
+                bool ok = false;
+                if (action == "on")
+                    ok = psctl.setAutoBoots(mask, 0);
+                else if (action == "off")
+                    ok = psctl.setAutoBoots(0, mask);
+                if ( ! ok)
                     printMsg("Problem setting Autoboot");
                 
                 break;
@@ -1046,8 +997,6 @@ while (true) {
 void faultMenu(PSCTL& psctl) {
 while (true) {
 
-    actProfile = psctl.getProfileStatus();
-    
     rc = system("clear");
     printf("Power*Star Fault Menu\n");
     printf("\nFaults Ignored:\n");
@@ -1151,8 +1100,6 @@ while (true) {
 void settingsMenu(PSCTL& psctl) {
    while (true) {
 
-    actProfile = psctl.getProfileStatus();
-    
     rc = system("clear");
     
     printf("Power*Star Settings\n\n");
@@ -1268,7 +1215,7 @@ void settingsMenu(PSCTL& psctl) {
                 }
 
                 if ( ! psctl.activateProfile(curProfile))
-                    printMsg("Problem activating profile");
+                    printMsg("Problem activating profile: " + psctl.profileReport());
                     
             break;
             }
@@ -1284,7 +1231,7 @@ void settingsMenu(PSCTL& psctl) {
                 
                 uint8_t svolt = (uint8_t)(psctl.statusMap["Var"].levels * 10);
                 if ( ! psctl.setVar(svolt))
-                    printMsg("Problem setting Var voltage");
+                    printRefused(psctl, "Problem setting Var voltage");
                 
                 break;
             }
@@ -1340,7 +1287,7 @@ void settingsMenu(PSCTL& psctl) {
         
                     
                     if ( ! psctl.setPWM(usract)) {
-                        printMsg("Problem setting PWM");
+                        printRefused(psctl, "Problem setting PWM");
                         break;
                     }
                     
@@ -1373,7 +1320,7 @@ void settingsMenu(PSCTL& psctl) {
                     }
         
                     if ( ! psctl.setDew(2, usract)) {
-                        printMsg("Problem setting Dew");
+                        printRefused(psctl, "Problem setting Dew");
                         break;
                     }
                     
@@ -1402,7 +1349,7 @@ void settingsMenu(PSCTL& psctl) {
                 }
 
                 if ( ! psctl.activateProfile(curProfile))
-                    printMsg("Problem activating profile");
+                    printMsg("Problem activating profile: " + psctl.profileReport());
                 
                 break;
             }
@@ -1417,6 +1364,273 @@ void settingsMenu(PSCTL& psctl) {
     }
 }
    
+//************************************************************
+void energyMenu(PSCTL& psctl) {
+while (true) {
+
+    psctl.getStatus();
+    PSENERGY *meter = psctl.energyMeter();
+    double ah[PSE_NPORTS], wh[PSE_NPORTS];
+    uint64_t sinceMs;
+    
+    rc = system("clear");
+    printf("Power*Star Energy\n\n");
+    
+    if ( ! psctl.getEnergy(ah, wh, &sinceMs)) {
+        printMsg("Energy counters unavailable (run as root to create " PS_ENERGY_FILE ")");
+        return;
+    }
+    
+    time_t since = sinceMs / 1000;
+    printf("Since: %s\n", ctime(&since));
+    
+    const char *names[PSE_NPORTS] = {curProfile.out1, curProfile.out2, curProfile.out3, curProfile.out4,
+        curProfile.dew1, curProfile.dew2, curProfile.var, curProfile.mp, "Total (IN)"};
+    
+    printf("Device             Amp-Hrs    Watt-Hrs\n");
+    for (int p = 0; p < PSE_NPORTS; p++) {
+        if (p == PSE_IN)
+            printf("\n");
+        printf("%-17s %8.2f    %8.1f\n", names[p], ah[p], wh[p]);
+    }
+    
+    printFaults(psctl);
+    
+    printf("\n('Enter' to refresh)\n");
+    printf("Cmd: R'eset counters, B'ack\n");
+    
+    printf("Command: ");
+        getline(cin, cimput);
+        boost::algorithm::to_lower(cimput);
+        char command = cimput[0];
+        switch(command) {
+            // reset counters
+            case 'r' : {
+                bool doreset = false;
+                askYN(&doreset, "reset of all Amp-Hr and Watt-Hr counters", false);
+                if (doreset && meter)
+                    meter->reset();
+                else if (doreset)
+                    printMsg("Counters belong to the process polling the Power*Star");
+                break;
+            }
+            
+            // return to previous menu
+            case 'b': {
+                break;
+            }
+            
+            default: {
+            }
+        }
+        if (command == 'b')
+            break;
+    }
+}
+
+//************************************************************
+void printWatch(const psWatchReport& rep) {
+    printf("%6.1fs  %7.0f reads/s  %6.0f Hz/port  gap %5.1fms  cmd %5.1fms  reaction <= %5.1fms  errors %llu\n",
+           rep.seconds, rep.rate, rep.portRate, rep.worstGapMs, rep.worstCmdMs, rep.reactionMs,
+           (unsigned long long)rep.errors);
+}
+
+//************************************************************
+void watchMenu(PSCTL& psctl) {
+while (true) {
+    
+    rc = system("clear");
+    printf("Power*Star Current Watch\n\n");
+    
+    const char *names[PSE_IN] = {curProfile.out1, curProfile.out2, curProfile.out3, curProfile.out4,
+        curProfile.dew1, curProfile.dew2, curProfile.var, curProfile.mp};
+    
+    printf("#  Device            Watch  Max Amps  Max A/s\n");
+    for (int p = 0; p < PSE_IN; p++)
+        printf("%d  %-17s %-5s  %8.2f  %7.1f\n", p + 1, names[p], watchLimit[p].watch ? "yes" : "no",
+               watchLimit[p].maxAmps, watchLimit[p].maxSlope);
+    
+    printf("\nA port going over its amps, or rising faster than its A/s, is turned off (0 = no limit)\n");
+    printf("Cmd: 1-8 set port limits, G'o, B'ack\n");
+    
+    printf("Command: ");
+        getline(cin, cimput);
+        boost::algorithm::to_lower(cimput);
+        char command = cimput[0];
+        
+        if (command >= '1' && command <= '8') {
+            int p = command - '1';
+            askYN(&watchLimit[p].watch, string("watch of ") + names[p]);
+            askFloat(&watchLimit[p].maxAmps, 0, 30, "max amps");
+            askFloat(&watchLimit[p].maxSlope, 0, 1000, "max rise A/s");
+            continue;
+        }
+        
+        switch(command) {
+            // run until Enter or every watched port is cut
+            case 'g' : {
+                PSWATCH watch(psctl);
+                if ( ! watch.start(watchLimit)) {
+                    printMsg("Nothing to watch, give a port an amp or A/s limit");
+                    break;
+                }
+                
+                printf("\nWatching - Hit ENTER to stop\n");
+                struct pollfd in = { 0, POLLIN, 0 };
+                while (watch.running() && poll(&in, 1, 1000) == 0)
+                    printWatch(watch.report());
+                watch.stop();
+                if (in.revents & POLLIN)
+                    getline(cin, message);
+                
+                psWatchReport rep = watch.report();
+                printf("\n");
+                printWatch(rep);
+                if (rep.tripped)
+                    printf("\033[1;31mCut: %s\033[0m\n", rep.reason);
+                printMsg("\nWatch ended");
+                break;
+            }
+            
+            // return to previous menu
+            case 'b': {
+                break;
+            }
+            
+            default: {
+            }
+        }
+        if (command == 'b')
+            break;
+    }
+}
+
+//************************************************************
+void burstMenu(PSCTL& psctl) {
+    rc = system("clear");
+    printf("Power*Star Burst Sampling\n\nChannels:");
+    for (int c = 0; c < PS_NCHAN; c++)
+        if (PSBURST::burstable(c))
+            printf(" %s", psChannels[c].name);
+    
+    printf("\n\nChannel [%s]: ", psChannels[burstChannel].name);
+    getline(cin, message);
+    if ( ! message.empty()) {
+        int c = 0;
+        while (c < PS_NCHAN && strcasecmp(message.c_str(), psChannels[c].name) != 0)
+            c++;
+        if (c == PS_NCHAN || ! PSBURST::burstable(c)) {
+            printMsg("Not a burst channel");
+            return;
+        }
+        burstChannel = c;
+    }
+    
+    askFloat(&burstSamples, 0, PS_BURST_MAX, "samples (0 = until the time)");
+    askFloat(&burstSeconds, 0, 600, "seconds (0 = until the samples)");
+    
+    printf("\nSampling %s ...\n", psChannels[burstChannel].name);
+    PSBURST burst(psctl);
+    if ( ! burst.run(burstChannel, burstSamples, burstSeconds * 1000)) {
+        printMsg(burst.stats().stopped ? "Burst stopped, the Power*Star isn't answering"
+                                       : "Burst failed, give samples or seconds");
+        return;
+    }
+    
+    const psBurstStats& st = burst.stats();
+    printf("%u samples in %.3fs, %u errors%s\n", st.samples, st.seconds, st.errors,
+           st.stopped ? ", stopped as the Power*Star isn't answering" : "");
+    printf("Rate %.0f cmds/s  mean %.3fms  worst %.3fms\n", st.rate, st.meanMs, st.worstMs);
+    printf("%s  min %g  mean %g  max %g %s\n", psChannels[burstChannel].name, st.min, st.mean, st.max,
+           psChannels[burstChannel].unit);
+    
+    printf("\nSave as C'SV, A'rchive or N'o? ");
+    getline(cin, message);
+    char save = message.empty() ? 'n' : tolower(message[0]);
+    if (save != 'c' && save != 'a')
+        return;
+    
+    string path = burst.fileName(save == 'c' ? ".csv" : ".psa");
+    bool ok = save == 'c' ? burst.writeCsv(path.c_str()) : burst.writeArchive(path.c_str());
+    printMsg(ok ? "Saved " + path : "Could not write " + path);
+}
+
+//************************************************************
+void printSequence(PSSEQUENCE& seq) {
+    psSeqProgress prog = seq.progress();
+    printf("%6.1fs  step %d of %d%s\n", prog.seconds, min(prog.step + 1, prog.steps), prog.steps,
+           prog.settling ? "  settling" : "");
+}
+
+//************************************************************
+void sequenceMenu(PSCTL& psctl) {
+while (true) {
+    
+    rc = system("clear");
+    printf("Power*Star Power Sequence (%s)\n\n", PS_SEQUENCE_FILE);
+    
+    PSSEQUENCE seq(psctl);
+    string error;
+    if ( ! seq.load(PS_SEQUENCE_FILE, error)) {
+        printMsg(string("Power sequence: ") + error);
+        return;
+    }
+    
+    for (int up = 1; up >= 0; up--) {
+        printf("%s:\n", up ? "Up" : "Down");
+        for (const psSeqStep& step : seq.plan(up)) {
+            printf("  %-5s %-4s", step.name, step.bit ? (step.level ? "on" : "off") : to_string(step.level).append("%").c_str());
+            if (step.afterMs)
+                printf("  after %ums", step.afterMs);
+            if (step.settle > 0)
+                printf("  settle %.2fA/s within %ums", step.settle, step.withinMs);
+            if (step.below > 0)
+                printf("  below %.2fA", step.below);
+            printf("\n");
+        }
+    }
+    
+    printf("\nCmd: U'p, D'own, B'ack\n");
+    
+    printf("Command: ");
+        getline(cin, cimput);
+        boost::algorithm::to_lower(cimput);
+        char command = cimput[0];
+        
+        if (command == 'b')
+            break;
+        if (command != 'u' && command != 'd')
+            continue;
+        
+        // run until done, failed or Enter
+        if ( ! seq.start(command == 'u')) {
+            printMsg("Nothing to run");
+            continue;
+        }
+        
+        printf("\nRunning - Hit ENTER to stop\n");
+        struct pollfd in = { 0, POLLIN, 0 };
+        while (seq.running() && poll(&in, 1, 250) == 0)
+            printSequence(seq);
+        seq.stop();
+        if (in.revents & POLLIN)
+            getline(cin, message);
+        
+        printf("\n");
+        for (const psSeqResult& res : seq.results()) {
+            printf("  %-5s at %7.1fms", res.name, res.atMs);
+            if (res.settleMs > 0)
+                printf("  settled %7.1fms  peak %5.2fA  now %5.2fA", res.settleMs, res.peakAmps, res.amps);
+            printf("%s\n", res.ok ? "" : "  \033[1;31mfailed\033[0m");
+        }
+        
+        psSeqProgress prog = seq.progress();
+        if (prog.failed)
+            printf("\033[1;31mStopped: %s\033[0m\n", prog.reason);
+        printMsg(prog.failed ? "\nSequence ended" : "\nSequence done in " + to_string(lround(prog.seconds * 1000)) + "ms");
+    }
+}
+
 //************************************************************
 void mainMenu(PSCTL& psctl) {
 while (true) {
@@ -1424,7 +1638,7 @@ while (true) {
     
     rc = system("clear");
 
-    printf("Power*Star Main Menu\n");
+    printf("Power*Star Main Menu%s\n", psctl.sharedReader() ? "  (status from driver)" : "");
     printf("\nDevice           State Current      F1     F2       USB      State\n");
     
     printf("%-17s %3s   %5.2f    %5s  %5s       %-10s\n",
@@ -1534,16 +1748,32 @@ while (true) {
     );
     
     float pswatts = psctl.statusMap["IN"].levels * psctl.statusMap["IN"].current;
+    double ah[PSE_NPORTS] = {0}, wh[PSE_NPORTS];
+    uint64_t since;
+    psctl.getEnergy(ah, wh, &since);
     printf("Volts-in: %5.2fV Amps-in: %5.2fA   Watts    %5.2fW  Amp-Hrs:  %6.1fAH\n",
            psctl.statusMap["IN"].levels,
            psctl.statusMap["IN"].current,
            pswatts,
-           0.0
+           ah[PSE_IN]
     );
 
     printFaults(psctl);
+    
+    if (psctl.usbState() != PS_USB_OK)
+        printf("\033[1;31mUSB: %s\033[0m\n", psUsbStates[psctl.usbState()]);
+    
+    if (psctl.alertRules() && ! psctl.alertRules()->active().empty())
+        printf("\033[1;33mAlerts: %s\033[0m\n", psctl.alertRules()->active().c_str());
+    
+    if (psctl.powerBudget()) {
+        printf("Budget:   %5.2fA of %5.2fA\n", psctl.powerBudget()->load(), psctl.powerBudget()->limit());
+        string note;
+        while (psctl.nextBudgetNote(note))
+            printf("\033[1;33m%s\033[0m\n", note.c_str());
+    }
         
-    printf("\nCmd: P'ower D'ew, F'ocus, H'andle Faults, S'ettings, R'estart Q'uit\n");
+    printf("\nCmd: P'ower D'ew, F'ocus, H'andle Faults, S'ettings, A'mp-Hrs, W'atch, B'urst, U'p/Down, R'estart Q'uit\n");
     
     printf("Command: ");
         getline(cin, cimput);
@@ -1568,33 +1798,66 @@ while (true) {
                 faultMenu(psctl);
                 break;              
             }
+            
+            // Energy Menu
+            case 'a': {
+                energyMenu(psctl);
+                break;              
+            }
+            
+            // Burst sampling of one channel
+            case 'b': {
+                burstMenu(psctl);
+                break;
+            }
+            
+            // Power up/down sequence
+            case 'u': {
+                sequenceMenu(psctl);
+                break;
+            }
+            
+            // Current watch
+            case 'w': {
+                watchMenu(psctl);
+                break;              
+            }
         
-            // turn output pwr and usb on/off
+            // turn output pwr and usb on/off, one or a list (out1,out2 usb3)
             case 'p': {;
-                char pwrdev[11] = " ";
-                askString(pwrdev, "device name", false);
-                boost::algorithm::to_lower(pwrdev);
-                device = string(pwrdev);
+                printf("Device name(s): ");
+                getline(cin, device);
+                boost::algorithm::to_lower(device);
                 
-                if (device == "mp" &&  psctl.statusMap["MP"].setting != 0) {
+                uint16_t mask;
+                if ( ! psctl.portMask(device, false, &mask)) {
+                    printMsg("ERROR: Unknown device, or not switched on/off (use D'ew)");
+                    break;
+                }
+                
+                uint16_t fixed = 0;
+                for (const psPort &p : psPorts)
+                    if (p.fixed)
+                        fixed |= p.mask;
+                
+                if (device != "all" && (mask & psPorts[PSE_MP].mask) && psctl.statusMap["MP"].setting != 0) {
                     printMsg("MP is not set to DC, use the M' command to change Dew or PWM settings");
                     break;
                 }
                 
-                if (device == "usb1" || device == "usb4" || device == "usb5") {
+                if (device != "all" && (mask & fixed)) {
                     printf("USB1,4,5 are not switchable\n");
                     break;
                 }
 
                 bool pwract;
                 askYN(&pwract, " ",false);
-                if ( pwract)
-                    action = "yes";
-                else
-                    action = "no";
 
-                if (! psctl.setPowerState(device, action))
+                uint16_t refused;
+                if (! (pwract ? psctl.setPowerStates(mask, 0, &refused) : psctl.setPowerStates(0, mask, &refused)))
                     printMsg("Problem configuring power");
+                else if (refused)
+                    printRefused(psctl, "Over the power budget");
                 
                 break;
             }
@@ -1638,7 +1901,7 @@ while (true) {
                 }
         
                 if ( ! psctl.setDew(udev, usract))
-                    printMsg("Problem setting Dew");
+                    printRefused(psctl, "Problem setting Dew");
                     //getline(cin, message);
                 break;
                 
@@ -1651,6 +1914,15 @@ while (true) {
             // restart
             case 'r' : {
                 psctl.restart();
+                
+                // wait for it to come back, the next poll puts the journal back
+                printf("Restarting ...\n");
+                usleep(PS_USB_REBOOT_MS * 1000);
+                psctl.getStatus();
+                string restored;
+                if (psctl.nextRestore(restored))
+                    printf("Restored %s\n", restored.c_str());
+                
                 psctl.Disconnect();
                 printf("Restarting: wait a moment before running this program again\n");
                 return;
@@ -1717,6 +1989,25 @@ int main (int argc, char* argv[])
     
     // set requested user limits initially to current limits on P*S
     psctl.getUserLimitStatus(reqUsrLimit);
+    
+    // share the driver's polling if it is running, otherwise poll for others
+    psctl.openShared();
+    
+    // amp-hour counters carry over from the last run
+    if ( ! psctl.sharedReader())
+        psctl.openEnergy(PS_ENERGY_FILE);
+    
+    // settings to put back if the Power*Star resets
+    psctl.openJournal(PS_STATE_FILE);
+    
+    // alert rules are optional, but say so if they don't compile
+    string error;
+    if (access(PS_RULES_FILE, F_OK) == 0 && ! psctl.openRules(PS_RULES_FILE, error))
+        printMsg(string("Alert rules: ") + error);
+    
+    // so is the power budget
+    if (access(PS_BUDGET_FILE, F_OK) == 0 && ! psctl.openBudget(PS_BUDGET_FILE, error))
+        printMsg(string("Power budget: ") + error);
 
     mainMenu(psctl);
         
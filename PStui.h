@@ -7,6 +7,15 @@
 #pragma once
 
 #include "PScontrol.h"
+#include "PSenergy.h"
+#include "PSfaults.h"
+#include "PSports.h"
+#include "PSwatch.h"
+#include "PSsequence.h"
+#include "PSburst.h"
+#include "PSrules.h"
+#include "PSjournal.h"
+#include "PSbudget.h"
 #include <boost/algorithm/string.hpp>
 #include <cmath>
 #include <cstring>
@@ -18,6 +27,8 @@
 #include <bits/stdc++.h> 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -59,6 +70,12 @@ int         rc;
 float       reqUsrLimit[12];
 float       curUsrLimit[12];
 
+psWatchLimit watchLimit[PSE_IN];
+
+int         burstChannel = PS_CH_OUT1_A;
+float       burstSamples = 1000;
+float       burstSeconds = 0;
+
 string      message;
 string      device = "";
 string      action = "";
@@ -0,0 +1,190 @@
+/***************************************************************
+*  Program:      PSwatch.cpp
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star high-rate current watch
+****************************************************************/
+
+#include "PSwatch.h"
+#include "PSports.h"
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+using namespace std;
+
+static double monoMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+//******************************************************************
+PSWATCH::~PSWATCH()
+{
+    stop();
+}
+
+//******************************************************************
+bool PSWATCH::start(const psWatchLimit limits[PSE_IN])
+{
+    if (active)
+        return false;
+    if (worker.joinable())
+        worker.join();
+
+    int watched = 0;
+    for (int p = 0; p < PSE_IN; p++) {
+        limit[p] = limits[p];
+        if (limit[p].watch && (limit[p].maxAmps > 0 || limit[p].maxSlope > 0))
+            watched++;
+        else
+            limit[p].watch = false;
+    }
+    if (watched == 0)
+        return false;
+
+    // dew currents are scaled by the dew setting of the last poll
+    psctl.getStatus();
+
+    memset(&stats, 0, sizeof(stats));
+    stopping = false;
+    active = true;
+    worker = thread(&PSWATCH::run, this);
+    return true;
+}
+
+//******************************************************************
+void PSWATCH::stop()
+{
+    stopping = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+//******************************************************************
+psWatchReport PSWATCH::report()
+{
+    lock_guard<mutex> guard(lock);
+    psWatchReport out = stats;
+
+    int watched = 0;
+    for (int p = 0; p < PSE_IN; p++)
+        if (limit[p].watch || (stats.tripped & (1 << p)))
+            watched++;
+
+    if (out.seconds > 0) {
+        out.rate = out.reads / out.seconds;
+        out.portRate = out.rate / watched;
+    }
+    out.reactionMs = out.worstGapMs + (out.cutMs > 0 ? out.cutMs : out.worstCmdMs);
+    return out;
+}
+
+//******************************************************************
+// Turns the port off, the rest of the port mask is left as it is now
+bool PSWATCH::cut(int port)
+{
+    if (port == PSE_DEW1 || port == PSE_DEW2)
+        return psctl.setDew(port - PSE_DEW1, 0);
+
+    return psctl.cutPorts(psPorts[port].mask);
+}
+
+//******************************************************************
+void PSWATCH::run()
+{
+    double begin = monoMs();
+    double last[PSE_IN] = {0};          // time of the last read of a port
+    double slopeAt[PSE_IN] = {0};       // start of the slope window
+    float  slopeAmps[PSE_IN] = {0};
+
+    while ( ! stopping) {
+        if ( ! psctl.hidBegin()) {
+            usleep(100000);
+            continue;
+        }
+
+        double turn = monoMs();
+        while ( ! stopping && monoMs() - turn < PSW_HOLD_MS) {
+            uint64_t reads = 0, errors = 0;
+            double worstGap = 0, worstCmd = 0;
+            int left = 0;
+
+            for (int p = 0; p < PSE_IN; p++) {
+                if ( ! limit[p].watch)
+                    continue;
+
+                float amps;
+                double t0 = monoMs();
+                bool ok = psctl.getCurrent(p, &amps);
+                double t1 = monoMs();
+                worstCmd = max(worstCmd, t1 - t0);
+                if ( ! ok) {
+                    errors++;
+                    left++;
+                    continue;
+                }
+                reads++;
+
+                if (last[p] > 0)
+                    worstGap = max(worstGap, t1 - last[p]);
+                last[p] = t1;
+
+                char why[64] = "";
+                if (limit[p].maxAmps > 0 && amps > limit[p].maxAmps)
+                    snprintf(why, sizeof(why), "%s %.2fA over %.2fA", psPorts[p].name, amps, limit[p].maxAmps);
+
+                if (slopeAt[p] == 0) {
+                    slopeAt[p] = t1;
+                    slopeAmps[p] = amps;
+                }
+                else if (t1 - slopeAt[p] >= PSW_SLOPE_MS) {
+                    float slope = (amps - slopeAmps[p]) * 1000 / (t1 - slopeAt[p]);
+                    if ( ! why[0] && limit[p].maxSlope > 0 && slope > limit[p].maxSlope)
+                        snprintf(why, sizeof(why), "%s rising %.1fA/s over %.1fA/s", psPorts[p].name, slope, limit[p].maxSlope);
+                    slopeAt[p] = t1;
+                    slopeAmps[p] = amps;
+                }
+
+                if ( ! why[0]) {
+                    left++;
+                    continue;
+                }
+
+                // over a limit: cut first, book-keeping after
+                double c0 = monoMs();
+                bool cutOk = cut(p);
+                double c1 = monoMs();
+                limit[p].watch = false;
+
+                lock_guard<mutex> guard(lock);
+                if (cutOk)
+                    stats.tripped |= 1 << p;
+                else
+                    stats.errors++;
+                stats.cutMs = max(stats.cutMs, c1 - c0);
+                if ( ! stats.reason[0])
+                    snprintf(stats.reason, sizeof(stats.reason), "%s%s", why, cutOk ? "" : " (cut failed)");
+            }
+
+            lock_guard<mutex> guard(lock);
+            stats.reads += reads;
+            stats.errors += errors;
+            stats.worstGapMs = max(stats.worstGapMs, worstGap);
+            stats.worstCmdMs = max(stats.worstCmdMs, worstCmd);
+            stats.seconds = (monoMs() - begin) / 1000;
+
+            // nothing left to watch
+            if (left == 0)
+                stopping = true;
+        }
+
+        psctl.hidEnd();
+        if ( ! stopping)
+            usleep(PSW_YIELD_US);
+    }
+
+    active = false;
+}
@@ -0,0 +1,82 @@
+/***************************************************************
+*  Program:      PSwatch.h
+*  Version:      20261019
+*  Author:       Sifan S. Kahale
+*  Description:  Power*Star high-rate current watch .h file
+****************************************************************/
+
+#pragma once
+
+#include "PScontrol.h"
+#include "PSenergy.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/*
+ * Reads PS_CURRENT for the watched ports back to back over a held USB
+ * session and cuts a port (PS_PORT_CTL, or dew to 0%) as soon as it
+ * goes over its amp limit or rises faster than its slope limit.
+ *
+ * A fault is seen at the latest one sample gap after it starts, so the
+ * worst-case reaction time is the longest gap between two reads of a
+ * port plus the time the cut command takes; both are measured.
+ *
+ * The USB is held for PSW_HOLD_MS at a time, then released briefly so
+ * the driver's poll can get in.  Other PSCTL calls must not be made
+ * from another thread while a watch is running.
+ *
+ * Ports are PSE_PORT numbers, which are the PS_CURRENT channels.  The
+ * 12V input (PSE_IN) can't be cut and isn't watchable.
+ */
+
+#define PSW_HOLD_MS         500             // USB held this long per turn
+#define PSW_YIELD_US        2000            // then let other processes in
+#define PSW_SLOPE_MS        20              // slope measured over at least this
+
+typedef struct {
+            bool     watch;
+            float    maxAmps;               // 0: no limit
+            float    maxSlope;              // A/s rising, 0: no limit
+} psWatchLimit;
+
+typedef struct {
+            uint64_t reads;                 // PS_CURRENT reads
+            uint64_t errors;
+            double   seconds;               // watched so far
+            double   rate;                  // reads/s, all ports
+            double   portRate;              // samples/s of each watched port
+            double   worstGapMs;            // longest time between two reads of a port
+            double   worstCmdMs;            // longest single command
+            double   cutMs;                 // slowest cut, 0 if none
+            double   reactionMs;            // worstGapMs + cut (or worstCmdMs)
+            uint16_t tripped;               // 1 << PSE_PORT of ports cut
+            char     reason[80];            // first trip
+} psWatchReport;
+
+class PSWATCH
+{
+    public:
+        PSWATCH(PSCTL &ctl) : psctl(ctl) {}
+        ~PSWATCH();
+
+        bool    start(const psWatchLimit limits[PSE_IN]);
+        void    stop();
+        bool    running() { return active; }
+
+        // snapshot, safe while running
+        psWatchReport report();
+
+    private:
+        void    run();
+        bool    cut(int port);
+
+        PSCTL       &psctl;
+        psWatchLimit limit[PSE_IN];
+
+        std::mutex        lock;
+        psWatchReport     stats;
+        std::thread       worker;
+        std::atomic<bool> active { false };
+        std::atomic<bool> stopping { false };
+};
@@ -1265,6 +1265,16 @@ void HID_API_EXPORT hid_close(hid_device *dev)
 }
 
 
+int HID_API_EXPORT hid_reset(hid_device *dev)
+{
+	if (!dev)
+		return -1;
+
+	/* The device may re-enumerate, the handle is only good for hid_close() after this. */
+	return libusb_reset_device(dev->device_handle) == 0 ? 0 : -1;
+}
+
+
 int HID_API_EXPORT_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen)
 {
 	return hid_get_indexed_string(dev, dev->manufacturer_index, string, maxlen);
@@ -323,6 +323,20 @@ extern "C" {
 		*/
 		void HID_API_EXPORT HID_API_CALL hid_close(hid_device *device);
 
+		/** @brief Reset the USB port of a HID device (libusb_reset_device).
+
+			Clears a stalled endpoint or a confused hub port without
+			unplugging.  If the device re-enumerates the handle is stale,
+			so close it and open the device again.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+
+			@returns
+				This function returns 0 on success and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_reset(hid_device *device);
+
 		/** @brief Get The Manufacturer String from a HID device.
 
 			@ingroup API